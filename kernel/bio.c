@@ -1,17 +1,22 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk,
+//     or bsubmit to start writing several and bwait to wait for
+//     each, to keep the writes in flight at once and send
+//     consecutive blocks to the disk together.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To start reading blocks that will be wanted soon,
+//     without waiting for them, call breadahead.
 
 
 #include "types.h"
@@ -22,70 +27,341 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "slab.h"
+#include "pstat.h"
 
-struct {
+// Buffers are kept in a hash table keyed by (dev, blockno),
+// each bucket with its own lock, so that bread() and brelse()
+// of different blocks rarely meet on a lock.  A buffer that
+// no one holds stays in its bucket, stamped with the time it
+// was released; a miss recycles the one released longest ago,
+// wherever it is.  bcache.lock serializes misses, so that two
+// can't pick the same buffer or cache the same block twice;
+// a miss takes bucket locks while holding it, one at a time
+// but for the bucket of the best buffer found so far.
+//
+// The cache has no fixed size.  Buffers come BPERGROUP to a
+// page from kalloc(), in a struct bufgroup.  A miss takes a
+// buffer that holds no block if there is one, else adds a
+// group while more than BCACHEHIGH pages are free, and only
+// then recycles a buffer.  While fewer than BCACHELOW pages
+// are free, each miss gives a group back, and kalloc() takes
+// back the page it needs before it fails (see breclaim()); only
+// groups none of whose buffers are in use go, and the cache
+// keeps at least NBUF buffers.
+#define NBUCKET 13
+#define BHASH(dev, blockno) (((dev)*31 + (blockno)) % NBUCKET)
+#define BPERGROUP (PGSIZE / BSIZE)
+#define BFREE ((uint)-1)  // dev of a buffer that holds no block
+
+struct bufgroup {
+  struct buf buf[BPERGROUP];
+  char *data;             // the page holding their data
+  struct bufgroup *next;
+};
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;       // linked through b->next
+  uint64 nhit;            // bget() calls that found their block here
+};
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct spinlock lock;
+  struct bucket bucket[NBUCKET];
+  struct objcache cache;  // of struct bufgroup
+  struct bufgroup *groups;
+  struct buf *free;       // buffers holding no block, through b->next
+  int nbuf;
+  int nfree;
+  uint64 nmiss;
+  uint64 nevict;
+  uint64 nahead;
+  uint64 ngrow;
+  uint64 nshrink;
 } bcache;
 
+// Add a group of buffers to the free list.
+// bcache.lock must be held.  Returns -1 if out of memory.
+static int
+bgrow(void)
+{
+  struct bufgroup *g;
+  struct buf *b;
+
+  if((g = objalloc(&bcache.cache)) == 0)
+    return -1;
+  if((g->data = kalloc()) == 0){
+    objfree(&bcache.cache, g);
+    return -1;
+  }
+  for(b = g->buf; b < g->buf+BPERGROUP; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->data = (uchar*)g->data + (b - g->buf) * BSIZE;
+    b->dev = BFREE;
+    b->refcnt = 0;
+    b->disk = 0;
+    b->iodone = 0;
+    b->next = bcache.free;
+    bcache.free = b;
+  }
+  g->next = bcache.groups;
+  bcache.groups = g;
+  bcache.nbuf += BPERGROUP;
+  bcache.nfree += BPERGROUP;
+  bcache.ngrow++;
+  return 0;
+}
+
 void
 binit(void)
+{
+  initlock(&bcache.lock, "bcache");
+  for(int i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+  objcache_init(&bcache.cache, "bufgroup", sizeof(struct bufgroup));
+
+  acquire(&bcache.lock);
+  while(bcache.nbuf < NBUF)
+    if(bgrow() < 0)
+      panic("binit");
+  release(&bcache.lock);
+}
+
+// Find the buffer for dev's block blockno in bk.
+// bk->lock must be held.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  initlock(&bcache.lock, "bcache");
+  for(b = bk->head; b; b = b->next)
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+  return 0;
+}
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+// Take b out of bk.  bk->lock must be held.
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  struct buf **bp;
+
+  for(bp = &bk->head; *bp != b; bp = &(*bp)->next)
+    ;
+  *bp = b->next;
+}
+
+// Take the unused buffer released longest ago out of its
+// bucket and return it, or 0 if every buffer is in use.
+// bcache.lock must be held.
+static struct buf*
+bvictim(void)
+{
+  struct bucket *bk, *vbk = 0;
+  struct buf *b, *victim = 0;
+
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    acquire(&bk->lock);
+    int better = 0;
+    for(b = bk->head; b; b = b->next){
+      if(b->refcnt == 0 && (victim == 0 || b->lastuse < victim->lastuse)){
+        victim = b;
+        better = 1;
+      }
+    }
+    if(better){
+      // keep the victim's bucket locked, so it stays unused.
+      if(vbk)
+        release(&vbk->lock);
+      vbk = bk;
+    } else {
+      release(&bk->lock);
+    }
+  }
+  if(victim == 0)
+    return 0;
+  bunlink(vbk, victim);
+  release(&vbk->lock);
+  return victim;
+}
+
+// Take g's buffers out of the cache, if none is in use.
+// bcache.lock must be held, so that no miss can hand one out
+// meanwhile.  Returns -1, leaving them all cached, if one is
+// in use.
+static int
+bempty(struct bufgroup *g)
+{
+  struct bucket *bk;
+  struct buf *b, **bp;
+  int i, busy = 0;
+
+  for(i = 0; i < BPERGROUP && !busy; i++){
+    b = &g->buf[i];
+    if(b->dev == BFREE)
+      continue;
+    bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+    acquire(&bk->lock);
+    busy = b->refcnt != 0;
+    if(!busy)
+      bunlink(bk, b);
+    release(&bk->lock);
   }
+  if(busy){
+    // put back the ones already taken out.
+    for(i -= 2; i >= 0; i--){
+      b = &g->buf[i];
+      if(b->dev == BFREE)
+        continue;
+      bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+      acquire(&bk->lock);
+      b->next = bk->head;
+      bk->head = b;
+      release(&bk->lock);
+    }
+    return -1;
+  }
+  for(bp = &bcache.free; *bp; ){
+    if(*bp >= g->buf && *bp < g->buf+BPERGROUP){
+      *bp = (*bp)->next;
+      bcache.nfree--;
+    } else {
+      bp = &(*bp)->next;
+    }
+  }
+  return 0;
+}
+
+// Give up to n groups back to kalloc(), keeping at least
+// NBUF buffers.  bcache.lock must be held.
+// Returns the number of pages freed.
+static int
+bshrink(int n)
+{
+  struct bufgroup *g, **gp;
+  int freed = 0;
+
+  for(gp = &bcache.groups; *gp && freed < n && bcache.nbuf - BPERGROUP >= NBUF; ){
+    g = *gp;
+    if(bempty(g) < 0){
+      gp = &g->next;
+      continue;
+    }
+    *gp = g->next;
+    kfree(g->data);
+    objfree(&bcache.cache, g);
+    bcache.nbuf -= BPERGROUP;
+    bcache.nshrink++;
+    freed++;
+  }
+  return freed;
+}
+
+// Memory has run out: give back up to n groups of buffers
+// that aren't in use.  kalloc() calls this before it fails.
+// Returns the number of pages freed.  Frees nothing if this
+// CPU is in the middle of a miss, which may be what is
+// calling kalloc().
+int
+breclaim(int n)
+{
+  int busy;
+
+  push_off();
+  busy = holding(&bcache.lock);
+  pop_off();
+  if(busy)
+    return 0;
+  acquire(&bcache.lock);
+  n = bshrink(n);
+  release(&bcache.lock);
+  return n;
 }
 
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
+// For read-ahead, return 0 instead if the block is cached
+// or there is no buffer for it.
 static struct buf*
-bget(uint dev, uint blockno)
+bget(uint dev, uint blockno, int ahead)
 {
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
   struct buf *b;
-
-  acquire(&bcache.lock);
+  uint64 nfree;
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(ahead){
+      release(&bk->lock);
+      return 0;
     }
+    b->refcnt++;
+    bk->nhit++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
+  // Not cached.  Look again once no other miss is under way,
+  // since one may have been for this block.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    if(ahead){
+      release(&bk->lock);
       release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+      return 0;
     }
+    b->refcnt++;
+    bk->nhit++;
+    release(&bk->lock);
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+  release(&bk->lock);
+  bcache.nmiss++;
+
+  // Use a buffer that holds no block, making more if memory
+  // is plentiful, or recycle the least recently used (LRU)
+  // unused buffer.  Grow even when memory is short if every
+  // buffer is in use.
+  nfree = kfreepagecount() / PGSIZE;
+  if(nfree < BCACHELOW)
+    bshrink(1);
+  else if(bcache.free == 0 && nfree > BCACHEHIGH)
+    bgrow();
+  if(bcache.free == 0){
+    if((b = bvictim()) != 0){
+      bcache.nevict++;
+    } else if(bgrow() < 0){
+      if(ahead){
+        release(&bcache.lock);
+        return 0;
+      }
+      panic("bget: no buffers");
+    }
+  }
+  if(b == 0){
+    b = bcache.free;
+    bcache.free = b->next;
+    bcache.nfree--;
+  }
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  acquire(&bk->lock);
+  b->next = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -94,7 +370,7 @@ bread(uint dev, uint blockno)
 {
   struct buf *b;
 
-  b = bget(dev, blockno);
+  b = bget(dev, blockno, 0);
   if(!b->valid) {
     virtio_disk_rw(b, 0);
     b->valid = 1;
@@ -102,6 +378,75 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Is dev's block blockno cached, or being read already?
+static int
+bcached(uint dev, uint blockno)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(dev, blockno)];
+  struct buf *b;
+
+  acquire(&bk->lock);
+  b = bfind(bk, dev, blockno);
+  release(&bk->lock);
+  return b != 0;
+}
+
+// Start reading the k buffers in run, just handed out by
+// bget(), which hold consecutive blocks.  Gives back those
+// the disk has no room for.  Returns how many it started.
+static int
+bstartrun(struct buf **run, int k)
+{
+  int started;
+
+  for(int i = 0; i < k; i++)
+    run[i]->iodone = bdone;
+  started = virtio_disk_trysubmit(run, k, 0);
+  for(int i = started; i < k; i++){
+    run[i]->iodone = 0;
+    brelse(run[i]);
+  }
+  __sync_fetch_and_add(&bcache.nahead, started);
+  return started;
+}
+
+// Start reading the n blocks of dev in blockno[] into the
+// cache, for a reader expected to want them soon, without
+// waiting for them.  Each run of consecutive blocks goes to
+// the disk as one request.  The buffers stay locked until
+// their reads complete, so a bread() of one meanwhile waits
+// for it rather than reading it again.  Blocks cached or
+// being read already are skipped.  Returns how many of the
+// blocks, from the first, it dealt with: fewer than n if it
+// ran out of buffers or of room in the disk's queue.
+int
+breadahead(uint dev, uint *blockno, int n)
+{
+  struct buf *b, *run[8];
+  int i, k = 0, started;
+
+  for(i = 0; i < n; i++){
+    if(bcached(dev, blockno[i]))
+      b = 0;
+    else if((b = bget(dev, blockno[i], 1)) == 0)
+      break;
+    // start the run so far if block i can't join it.
+    if(k > 0 && (b == 0 || blockno[i] != blockno[i-1] + 1 || k == NELEM(run))){
+      if((started = bstartrun(run, k)) < k){
+        if(b)
+          brelse(b);
+        return i - k + started;
+      }
+      k = 0;
+    }
+    if(b)
+      run[k++] = b;
+  }
+  if(k > 0 && (started = bstartrun(run, k)) < k)
+    return i - k + started;
+  return i;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -111,8 +456,56 @@ bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Start writing the contents of the n buffers in bs to disk,
+// and return without waiting; bwait(b) waits for each.  They
+// must be locked, and stay locked until bwait() returns.
+// Sorts bs by block number, so that each run of consecutive
+// blocks goes to the disk as one request.
+void
+bsubmit(struct buf **bs, int n)
+{
+  struct buf *b;
+  int i, j;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock))
+      panic("bsubmit");
+    b = bs[i];
+    for(j = i; j > 0 && bs[j-1]->blockno > b->blockno; j--)
+      bs[j] = bs[j-1];
+    bs[j] = b;
+  }
+  for(i = 0; i < n; i = j){
+    for(j = i + 1; j < n && bs[j]->blockno == bs[j-1]->blockno + 1; j++)
+      ;
+    virtio_disk_submit(bs + i, j - i, 1);
+  }
+}
+
+// Wait for a write started by bsubmit().
+void
+bwait(struct buf *b)
+{
+  virtio_disk_wait(b);
+}
+
+// Drop a reference to b, stamping it with the time, for
+// bvictim(), if no one else holds it.
+static void
+bput(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    // no one is waiting for it.
+    b->lastuse = timenow();
+  }
+  release(&bk->lock);
+}
+
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
 void
 brelse(struct buf *b)
 {
@@ -120,34 +513,53 @@ brelse(struct buf *b)
     panic("brelse");
 
   releasesleep(&b->lock);
+  bput(b);
+}
 
-  acquire(&bcache.lock);
-  b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+// The disk has finished a read started by breadahead().
+// Called from the disk interrupt, as b->iodone, with b still locked by the
+// process that started it.
+void
+bdone(struct buf *b)
+{
+  b->valid = 1;
+  releasesleep(&b->lock);
+  bput(b);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
-
+// Fill in *bs with a snapshot of the buffer cache's counters.
+void
+bstat(struct bstat *bs)
+{
+  memset(bs, 0, sizeof(*bs));
+  acquire(&bcache.lock);
+  bs->nbuf = bcache.nbuf;
+  bs->nfree = bcache.nfree;
+  bs->nmiss = bcache.nmiss;
+  bs->nevict = bcache.nevict;
+  bs->nahead = bcache.nahead;
+  virtio_disk_stat(&bs->ndiskreq, &bs->ndiskblock);
+  bs->ngrow = bcache.ngrow;
+  bs->nshrink = bcache.nshrink;
+  release(&bcache.lock);
+  for(int i = 0; i < NBUCKET; i++)
+    bs->nhit += bcache.bucket[i].nhit;
+}
@@ -1,12 +1,13 @@
 struct buf {
   int valid;   // has data been read from disk?
   int disk;    // does disk "own" buf?
+  void (*iodone)(struct buf*); // if set, the disk interrupt calls it when done
   uint dev;
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
-  uchar data[BSIZE];
+  uint64 lastuse; // mtime when refcnt last fell to 0
+  struct buf *next; // hash bucket list
+  uchar *data;  // BSIZE bytes, in a page shared with other buffers
 };
 
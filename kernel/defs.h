@@ -9,14 +9,25 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct rusage;
+struct memstat;
+struct cpustat;
+struct bstat;
+struct schedparam;
+struct mmr;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bsubmit(struct buf**, int);
+void            bwait(struct buf*);
+int             breadahead(uint, uint*, int);
+void            bdone(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             breclaim(int);
+void            bstat(struct bstat*);
 
 // console.c
 void            consoleinit(void);
@@ -62,9 +73,16 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kzalloc(void);
+int             kzeroidle(void);
 void            kfree(void *);
+void*           kalloc_order(int);
+void            kfree_order(void *, int);
+void            kdup(void *);
+int             krefcnt(void *);
 void            kinit(void);
 uint64          kfreepagecount(void);
+void            kmemstat(struct memstat*);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -72,7 +90,25 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// pcache.c
+void            pcacheinit(void);
+char*           pcget(struct inode*, uint);
+void            pcwrite(struct inode*, uint, char*, uint);
+void            pcdrop(struct inode*);
+
+// mmr.c
+void            mmrinit(void);
+struct mmr*     mmralloc(void);
+void            mmrfree(struct mmr*);
+void            mmrinsert(struct proc*, struct mmr*);
+void            mmrdelete(struct proc*, struct mmr*);
+struct mmr*     mmrfind(struct proc*, uint64);
+struct mmr*     mmrnext(struct proc*, uint64);
+struct mmr*     mmrsplit(struct proc*, struct mmr*, uint64);
+struct mmr*     mmrmerge(struct proc*, struct mmr*);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -87,8 +123,8 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+void            kstackflush(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -109,13 +145,18 @@ int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 int             procinfo(uint64 addr);
 void            queueinit(void);
-int             queue_empty(int);
+int             queue_empty(int, int);
 int             timeslice(int);
+void            cpustat(struct cpustat*);
+int             schedtick(struct proc*);
+int             preempted(struct proc*);
+int             setpolicy(int);
+int             setclass(int, int);
+int             settickets(int);
+void            priboost(void);
+void            getschedparam(struct schedparam*);
+int             setschedparam(struct schedparam*);
 uint64          freepmem(void);
-struct          mmr_list* get_mmr_list(int);
-int             alloc_mmr_listid(void);
-void            dealloc_mmr_listid(int);
-void            mmrlistinit(void);
 
 
 // swtch.S
@@ -135,6 +176,17 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// slab.c
+struct objcache;
+void            objcache_init(struct objcache*, char*, uint);
+void*           objalloc(struct objcache*);
+void            objfree(struct objcache*, void*);
+
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+
 //semaphore.c
 void            seminit(void);
 int             semalloc(void);
@@ -157,8 +209,19 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+int             munmap(uint64, uint64);
+
+// timer.c
+void            timerqinit(void);
+uint64          timenow(void);
+void            timerarm(void);
+int             timerintr(void);
+int             sleepuntil(uint64);
+
 // trap.c
 extern uint     ticks;
+void            clockintr(uint);
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -175,6 +238,8 @@ int             uartgetc(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
+void            kvmmapstack(uint64, uint64);
+uint64          kvmunmapstack(uint64);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
@@ -182,14 +247,19 @@ uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
+int             uvmsplit(pagetable_t, uint64);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
-int             mapvpages(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64, uint64);
 int             uvmcopyshared(pagetable_t, pagetable_t, uint64, uint64);
+int             cowpage(pagetable_t, uint64);
+int             cowcopy(pagetable_t, uint64);
+uint64          vmfault(pagetable_t, uint64, int);
+void            uvmprefault(pagetable_t, uint64, uint64, int);
+uint64          uvmdirty(pagetable_t, uint64);
 
 // plic.c
 void            plicinit(void);
@@ -200,6 +270,10 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_submit(struct buf **, int, int);
+int             virtio_disk_trysubmit(struct buf **, int, int);
+void            virtio_disk_wait(struct buf *);
+void            virtio_disk_stat(uint64 *, uint64 *);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
@@ -20,6 +20,9 @@ struct inode {
   int ref;            // Reference count
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  uint raoff;         // where the last readi() ended
+  uint rawin;         // blocks to read ahead of a sequential reader
+  uint ranext;        // first block not yet read ahead
 
   short type;         // copy of disk inode
   short major;
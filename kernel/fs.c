@@ -267,6 +267,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->raoff = ip->rawin = ip->ranext = 0;
   release(&itable.lock);
 
   return ip;
@@ -413,6 +414,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcdrop(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -448,6 +451,47 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Start reading ahead of a read of n bytes at off from ip.
+// A read that starts where the last one ended is taken as
+// sequential and doubles ip's window, up to READAHEAD blocks
+// past the end of the read; any other read shuts it.  Blocks
+// in the window, and those of the read itself, that haven't
+// been asked for yet are started in the background, so the
+// disk works on them while readi() copies out the first.
+// Caller must hold ip->lock.
+static void
+readahead(struct inode *ip, uint off, uint n)
+{
+  uint bn, end, blockno[8];
+  int k, done;
+
+  if(n == 0)
+    return;
+  if(off == ip->raoff){
+    ip->rawin = ip->rawin ? min(2*ip->rawin, READAHEAD) : 2;
+  } else {
+    ip->rawin = 0;
+    ip->ranext = 0;
+  }
+  ip->raoff = off + n;
+  if(ip->rawin == 0)
+    return;
+
+  // blocks from the read's first up to end, but none past EOF.
+  end = min((off + n - 1) / BSIZE + ip->rawin, (ip->size - 1) / BSIZE) + 1;
+  bn = ip->ranext > off / BSIZE ? ip->ranext : off / BSIZE;
+  while(bn < end){
+    for(k = 0; k < NELEM(blockno) && bn + k < end; k++)
+      blockno[k] = bmap(ip, bn + k);
+    done = breadahead(ip->dev, blockno, k);
+    bn += done;
+    if(done < k)
+      break;  // disk busy; try again next time.
+  }
+  if(bn > ip->ranext)
+    ip->ranext = bn;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -462,6 +506,7 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  readahead(ip, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -501,6 +546,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
+    pcwrite(ip, off, (char*)bp->data + (off % BSIZE), m);
     log_write(bp);
     brelse(bp);
   }
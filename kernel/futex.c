@@ -0,0 +1,128 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futex(addr, FUTEX_WAIT, val) sleeps if the int at addr still
+// holds val, and futex(addr, FUTEX_WAKE, n) wakes up to n of
+// the processes sleeping on addr.  User code keeps its locks
+// and semaphores in its own memory, changes them with atomic
+// instructions, and enters the kernel only to sleep when it
+// must wait and to wake sleepers that are there to be woken
+// (see user/usync.c).
+//
+// Sleepers are keyed by the physical address of the word, so
+// that processes sharing memory through MAP_SHARED mappings
+// meet on the same key wherever the memory is mapped.  They
+// wait on a hash table of queues.  A sleeper checks the word
+// and joins its queue under the queue's lock, and a waker
+// takes the same lock, so a wake that follows a change to the
+// word can't slip in between a sleeper's check and its sleep.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXQ 61
+#define FUTEXHASH(key) (((key) >> 2) % NFUTEXQ)
+
+// a sleeper, on its own kernel stack.
+struct futexwaiter {
+  uint64 key;
+  int woken;
+  struct futexwaiter *next;
+};
+
+struct futexq {
+  struct spinlock lock;
+  struct futexwaiter *head;
+} futexq[NFUTEXQ];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXQ; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+// Return the physical address of the int at user address
+// addr, faulting its page in if need be, or 0 if addr is
+// unaligned or not mapped.
+static uint64
+futexkey(uint64 addr)
+{
+  pagetable_t pagetable = myproc()->pagetable;
+  uint64 va = PGROUNDDOWN(addr), pa;
+
+  if(addr % sizeof(int))
+    return 0;
+  if((pa = walkaddr(pagetable, va)) == 0 && (pa = vmfault(pagetable, va, 0)) == 0)
+    return 0;
+  return pa + (addr - va);
+}
+
+// Sleep on addr if the int there is val.  Returns 0 once
+// woken, or -1 at once if the int isn't val, or if killed.
+int
+futexwait(uint64 addr, int val)
+{
+  struct futexwaiter w, **wp;
+  struct futexq *fq;
+  uint64 key;
+  int woken;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  fq = &futexq[FUTEXHASH(key)];
+  acquire(&fq->lock);
+  if(*(volatile int *)key != val){
+    release(&fq->lock);
+    return -1;
+  }
+  w.key = key;
+  w.woken = 0;
+  w.next = 0;
+  for(wp = &fq->head; *wp; wp = &(*wp)->next)
+    ;
+  *wp = &w;
+  while(!w.woken && !myproc()->killed)
+    sleep(&w, &fq->lock);
+  woken = w.woken;
+  if(!woken){
+    for(wp = &fq->head; *wp != &w; wp = &(*wp)->next)
+      ;
+    *wp = w.next;
+  }
+  release(&fq->lock);
+  return woken ? 0 : -1;
+}
+
+// Wake up to n processes sleeping on addr, in the order they
+// went to sleep.  Returns how many were woken, or -1 if addr
+// is unaligned or not mapped.
+int
+futexwake(uint64 addr, int n)
+{
+  struct futexwaiter *w, **wp;
+  struct futexq *fq;
+  uint64 key;
+  int nwoken = 0;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  fq = &futexq[FUTEXHASH(key)];
+  acquire(&fq->lock);
+  for(wp = &fq->head; *wp && nwoken < n; ){
+    w = *wp;
+    if(w->key != key){
+      wp = &w->next;
+      continue;
+    }
+    *wp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    nwoken++;
+  }
+  release(&fq->lock);
+  return nwoken;
+}
@@ -1,6 +1,27 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or physically contiguous blocks of 2^order pages.
+//
+// The global pool is a buddy allocator: free blocks of
+// 2^k pages, aligned to their size in physical memory,
+// sit on list free[k] for k < NORDER, and a freed block
+// merges with its buddy whenever both halves are free.
+// kalloc_order() and kfree_order() use it directly.
+//
+// Each CPU keeps a small cache of free pages so that most
+// kalloc() and kfree() calls only touch that CPU's list.
+// Caches refill from and drain to the buddy pool in batches
+// of KCACHEBATCH pages; a CPU whose cache and the global
+// pool are both empty steals from another CPU's cache.
+//
+// kzalloc() hands out pages that are already zero, taken
+// from a small pool that idle CPUs fill via kzeroidle().
+//
+// Every allocated page has a reference count, so that
+// fork() can share pages copy-on-write.  Allocation sets
+// it to 1, kdup() adds a reference, and kfree() only frees
+// the page when the last reference goes away.
 
 #include "types.h"
 #include "param.h"
@@ -8,35 +29,242 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "pstat.h"
 
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// first word(s) of a free page or block.
+// per-CPU lists use only next; buddy lists are
+// circular and doubly linked so a buddy can be
+// unlinked from the middle when it merges.
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
+#define NPAGES ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PGINDEX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
+// global buddy pool.
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run free[NORDER]; // list heads, one per order
+  uint64 nblock[NORDER];   // free blocks on each list
+  uchar order[NPAGES];     // order+1 if the page heads a free block, else 0
+  uint64 nfree;            // free pages in all blocks
+  uint64 npages;           // pages handed to the allocator at boot
+  uint64 hiwater;          // most pages ever out of the pool
 } kmem;
 
+// per-CPU free page caches.
+// kcache[i].lock is almost always taken by CPU i only;
+// other CPUs take it just to steal pages.
+// lock order: kcache[i].lock, then kmem.lock.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;             // number of pages on freelist
+  uint64 nalloc;         // successful kalloc() calls on this CPU
+  uint64 nfreed;         // kfree() calls on this CPU
+  uint64 nfail;          // kalloc() calls that found no memory
+} kcache[NCPU];
+
+// reference count of each allocated page, indexed by PGINDEX.
+// updated with atomic instructions, not under a lock.
+int pgref[NPAGES];
+
+// pages zeroed ahead of time for kzalloc().
+// lock order: kcache[i].lock, then kzero.lock.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;             // number of pages on freelist
+} kzero;
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int k = 0; k < NORDER; k++)
+    kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
+  initlock(&kzero.lock, "kzero");
   freerange(end, (void*)PHYSTOP);
 }
 
+// Remove a free block of 2^order pages from the buddy pool,
+// splitting a larger block if necessary.
+// Returns 0 if no block is big enough.
+// kmem.lock must be held.
+static struct run *
+buddy_alloc(int order)
+{
+  struct run *r, *b;
+  int k;
+
+  for(k = order; k < NORDER; k++)
+    if(kmem.free[k].next != &kmem.free[k])
+      break;
+  if(k == NORDER)
+    return 0;
+
+  r = kmem.free[k].next;
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.nblock[k]--;
+  kmem.order[PGINDEX(r)] = 0;
+
+  // give back the upper half until r is the right size.
+  while(k > order){
+    k--;
+    b = (struct run*)((char*)r + (PGSIZE << k));
+    b->next = kmem.free[k].next;
+    b->prev = &kmem.free[k];
+    kmem.free[k].next->prev = b;
+    kmem.free[k].next = b;
+    kmem.nblock[k]++;
+    kmem.order[PGINDEX(b)] = k + 1;
+  }
+
+  kmem.nfree -= 1L << order;
+  return r;
+}
+
+// Return a block of 2^order pages to the buddy pool,
+// merging it with its buddy for as long as the buddy
+// is free and of the same size.
+// kmem.lock must be held.
+static void
+buddy_free(struct run *r, int order)
+{
+  struct run *b;
+  uint64 bi;
+
+  kmem.nfree += 1L << order;
+
+  while(order < NORDER-1){
+    bi = PGINDEX(r) ^ (1L << order);
+    if(bi >= NPAGES || kmem.order[bi] != order + 1)
+      break;
+    b = (struct run*)(KERNBASE + bi*PGSIZE);
+    b->prev->next = b->next;
+    b->next->prev = b->prev;
+    kmem.nblock[order]--;
+    kmem.order[bi] = 0;
+    if(b < r)
+      r = b;
+    order++;
+  }
+
+  r->next = kmem.free[order].next;
+  r->prev = &kmem.free[order];
+  kmem.free[order].next->prev = r;
+  kmem.free[order].next = r;
+  kmem.nblock[order]++;
+  kmem.order[PGINDEX(r)] = order + 1;
+}
+
 void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    if(KJUNK)
+      memset(p, 1, PGSIZE);
+    acquire(&kmem.lock);
+    buddy_free((struct run*)p, 0);
+    kmem.npages++;
+    release(&kmem.lock);
+  }
+}
+
+// Move up to KCACHEBATCH pages from the buddy pool to c.
+// c->lock must be held.
+static void
+krefill(struct kcache *c)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  for(int i = 0; i < KCACHEBATCH; i++){
+    if((r = buddy_alloc(0)) == 0)
+      break;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->nfree++;
+  }
+  // pages parked in per-CPU caches count as out of the pool,
+  // so the high-water mark errs high by at most NCPU*KCACHEMAX.
+  if(kmem.npages - kmem.nfree > kmem.hiwater)
+    kmem.hiwater = kmem.npages - kmem.nfree;
+  release(&kmem.lock);
+}
+
+// Move up to n pages from c back to the buddy pool.
+// c->lock must be held.
+static void
+kdrain(struct kcache *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  for(int i = 0; i < n && c->freelist; i++){
+    r = c->freelist;
+    c->freelist = r->next;
+    c->nfree--;
+    buddy_free(r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Take half of the pages cached by some other CPU,
+// keep all but one in this CPU's cache, and return that one.
+// Returns 0 if every cache is empty.
+// Called with interrupts off and no kcache lock held,
+// so that two CPUs stealing from each other can't deadlock.
+static struct run *
+ksteal(int id)
+{
+  struct run *r, *stolen, *last;
+  struct kcache *victim;
+  int n;
+
+  for(int i = 1; i < NCPU; i++){
+    victim = &kcache[(id + i) % NCPU];
+    if(victim->nfree == 0)   // racy peek; rechecked under the lock.
+      continue;
+
+    acquire(&victim->lock);
+    n = (victim->nfree + 1) / 2;
+    stolen = last = victim->freelist;
+    for(int j = 1; j < n && last; j++)
+      last = last->next;
+    if(last){
+      victim->freelist = last->next;
+      victim->nfree -= n;
+      last->next = 0;
+    }
+    release(&victim->lock);
+
+    if(stolen == 0)
+      continue;
+
+    r = stolen;
+    if(r->next){
+      acquire(&kcache[id].lock);
+      last->next = kcache[id].freelist;
+      kcache[id].freelist = r->next;
+      kcache[id].nfree += n - 1;
+      release(&kcache[id].lock);
+    }
+    return r;
+  }
+  return 0;
 }
 
 // Free the page of physical memory pointed at by v,
@@ -47,52 +275,299 @@ void
 kfree(void *pa)
 {
   struct run *r;
+  struct kcache *c;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if(pgref[PGINDEX(pa)] < 1)
+    panic("kfree: ref");
+  if(__sync_sub_and_fetch(&pgref[PGINDEX(pa)], 1) > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  if(KJUNK)
+    memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  c->nfreed++;
+  if(c->nfree > KCACHEMAX)
+    kdrain(c, KCACHEBATCH);
+  release(&c->lock);
+  pop_off();
+}
+
+// Take a free page from this CPU's cache, the global pool,
+// another CPU's cache, or as a last resort the zeroed pool.
+// Must be called with interrupts off.
+static struct run *
+kget(void)
+{
+  struct run *r;
+  struct kcache *c = &kcache[cpuid()];
+
+  acquire(&c->lock);
+  if(c->freelist == 0)
+    krefill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->nfree--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = ksteal(cpuid());
+  if(r == 0){
+    acquire(&kzero.lock);
+    r = kzero.freelist;
+    if(r){
+      kzero.freelist = r->next;
+      kzero.nfree--;
+    }
+    release(&kzero.lock);
+  }
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
+// If none is free, takes pages back from the buffer cache.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  push_off();
+  c = &kcache[cpuid()];
+  if((r = kget()) == 0 && breclaim(1) > 0)
+    r = kget();
   if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+    c->nalloc++;
+  else
+    c->nfail++;
+  pop_off();
+
+  if(r){
+    pgref[PGINDEX(r)] = 1;
+    if(KJUNK)
+      memset((char*)r, 5, PGSIZE); // fill with junk
+  }
+  return (void*)r;
+}
+
+// Allocate one zero-filled page of physical memory.
+// Uses a page zeroed earlier by kzeroidle() if one is ready.
+// Returns 0 if the memory cannot be allocated.
+void *
+kzalloc(void)
+{
+  struct run *r;
+  struct kcache *c;
+
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.nfree--;
+  }
+  release(&kzero.lock);
+  if(r){
+    r->next = 0;  // the only non-zero word.
+  } else {
+    if((r = kget()) == 0 && breclaim(1) > 0)
+      r = kget();
+    if(r)
+      memset((char*)r, 0, PGSIZE);
+  }
+  if(r)
+    c->nalloc++;
+  else
+    c->nfail++;
+  pop_off();
 
   if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+    pgref[PGINDEX(r)] = 1;
   return (void*)r;
 }
 
-uint64
-kfreepagecount()
+// Zero one free page for a later kzalloc(), if the zeroed
+// pool is below NZEROPG.  Called by the scheduler when this
+// CPU has nothing to run, so the memset is off the fault path.
+// Returns 1 if it zeroed a page, 0 if there was nothing to do.
+int
+kzeroidle(void)
 {
   struct run *r;
-  acquire(&kmem.lock);
-  r= kmem.freelist;
-  int count = 0;
 
-  while(r){
-    count += 1;
-    r = r->next;
+  if(kzero.nfree >= NZEROPG)  // racy peek is fine; it's a hint.
+    return 0;
+
+  push_off();
+  r = kget();
+  pop_off();
+  if(r == 0)
+    return 0;
+
+  memset((char*)r, 0, PGSIZE);
+
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.nfree++;
+  release(&kzero.lock);
+  return 1;
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size.  kalloc_order(0) is the same as kalloc().
+// If no block is big enough, flushes the per-CPU caches back
+// to the buddy pool so their pages can merge, and retries.
+// Unlike kalloc(), doesn't take pages from the buffer cache:
+// its pages are scattered, and callers such as vmfault()'s
+// megapage attempt have a fallback.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_order(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order >= NORDER)
+    panic("kalloc_order");
+  if(order == 0)
+    return kalloc();
+
+  for(int pass = 0; pass < 2; pass++){
+    acquire(&kmem.lock);
+    r = buddy_alloc(order);
+    if(r && kmem.npages - kmem.nfree > kmem.hiwater)
+      kmem.hiwater = kmem.npages - kmem.nfree;
+    release(&kmem.lock);
+    if(r)
+      break;
+
+    for(int i = 0; i < NCPU; i++){
+      acquire(&kcache[i].lock);
+      kdrain(&kcache[i], kcache[i].nfree);
+      release(&kcache[i].lock);
+    }
+  }
+
+  push_off();
+  if(r)
+    kcache[cpuid()].nalloc++;
+  else
+    kcache[cpuid()].nfail++;
+  pop_off();
+
+  if(r){
+    for(int i = 0; i < (1 << order); i++)
+      pgref[PGINDEX(r) + i] = 1;
+    if(KJUNK)
+      memset((char*)r, 5, PGSIZE << order);
   }
+  return (void*)r;
+}
+
+// Free a block returned by kalloc_order(order).
+// If some of its pages have been kdup()ed, drop one
+// reference to each page instead, so that they are freed
+// one at a time as their last references go.
+void
+kfree_order(void *pa, int order)
+{
+  if(order < 0 || order >= NORDER)
+    panic("kfree_order");
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+
+  if(((uint64)pa % (PGSIZE << order)) != 0 || (char*)pa < end ||
+     (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+
+  for(int i = 0; i < (1 << order); i++){
+    if(pgref[PGINDEX(pa) + i] > 1){
+      for(i = 0; i < (1 << order); i++)
+        kfree((char*)pa + i*PGSIZE);
+      return;
+    }
+  }
+
+  for(int i = 0; i < (1 << order); i++)
+    pgref[PGINDEX(pa) + i] = 0;
+
+  if(KJUNK)
+    memset(pa, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  buddy_free((struct run*)pa, order);
   release(&kmem.lock);
+
+  push_off();
+  kcache[cpuid()].nfreed++;
+  pop_off();
+}
+
+// Add a reference to an allocated page, which will
+// now take one more kfree() to free.
+void
+kdup(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kdup");
+  if(__sync_fetch_and_add(&pgref[PGINDEX(pa)], 1) < 1)
+    panic("kdup: free page");
+}
+
+// Number of references to an allocated page.
+int
+krefcnt(void *pa)
+{
+  return pgref[PGINDEX(pa)];
+}
+
+// Number of free bytes, summed from the counters kept by
+// the global pool and each per-CPU cache.  Takes no locks,
+// so the result is a snapshot that may be slightly stale.
+uint64
+kfreepagecount()
+{
+  uint64 count = kmem.nfree + kzero.nfree;
+
+  for(int i = 0; i < NCPU; i++)
+    count += kcache[i].nfree;
   return count * PGSIZE;
 }
+
+// Fill in *ms with a snapshot of the allocator's counters.
+void
+kmemstat(struct memstat *ms)
+{
+  memset(ms, 0, sizeof(*ms));
+  ms->total = kmem.npages;
+  ms->free = kmem.nfree;
+  ms->hiwater = kmem.hiwater;
+  for(int k = 0; k < NORDER; k++)
+    ms->nblock[k] = kmem.nblock[k];
+  for(int i = 0; i < NCPU; i++){
+    ms->cached += kcache[i].nfree;
+    ms->nalloc += kcache[i].nalloc;
+    ms->nfree += kcache[i].nfreed;
+    ms->nfail += kcache[i].nfail;
+  }
+  ms->zeroed = kzero.nfree;
+  ms->free += ms->cached + ms->zeroed;
+  ms->ticks = timenow() / TICKCYCLES;
+}
@@ -28,7 +28,8 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous: commit() waits for every block
+// of the log to reach the disk before it writes the header.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -64,21 +65,28 @@ initlog(int dev, struct superblock *sb)
   recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// All the writes are started together, after the copying, so
+// the disk can work on them at once and take neighbouring
+// blocks in one request.
 static void
 install_trans(int recovering)
 {
   int tail;
+  struct buf *dbuf[LOGSIZE];
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    if(recovering == 0)
-      bunpin(dbuf);
+    dbuf[tail] = bread(log.dev, log.lh.block[tail]); // read dst
+    memmove(dbuf[tail]->data, lbuf->data, BSIZE);  // copy block to dst
     brelse(lbuf);
-    brelse(dbuf);
+  }
+  bsubmit(dbuf, log.lh.n);  // start writing dsts to disk
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(dbuf[tail]);
+    if(recovering == 0)
+      bunpin(dbuf[tail]);
+    brelse(dbuf[tail]);
   }
 }
 
@@ -174,19 +182,25 @@ end_op(void)
   }
 }
 
-// Copy modified blocks from cache to log.
+// Copy modified blocks from cache to log, then write them all
+// at once; the log is contiguous, so they go to the disk in
+// as few requests as the driver allows.
 static void
 write_log(void)
 {
   int tail;
+  struct buf *to[LOGSIZE];
 
   for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
+    to[tail] = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
+    memmove(to[tail]->data, from->data, BSIZE);
     brelse(from);
-    brelse(to);
+  }
+  bsubmit(to, log.lh.n);  // start writing the log
+  for (tail = 0; tail < log.lh.n; tail++) {
+    bwait(to[tail]);
+    brelse(to[tail]);
   }
 }
 
@@ -20,9 +20,11 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
-    //mmrlistinit();
+    mmrinit();       // mmap region cache
     seminit();      // Initialize the semaphores
-    //queueinit();    // Initializes queue data structures
+    futexinit();     // futex wait queues
+    queueinit();     // per-CPU scheduler queues
+    timerqinit();    // per-CPU sleep timers
     trapinit();     // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
@@ -30,6 +32,8 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe object cache
+    pcacheinit();    // page cache for mapped files
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -0,0 +1,286 @@
+// Per-process index of memory-mapped regions.
+//
+// A process's regions never overlap, so they are kept in an
+// AVL tree ordered by start address, rooted at p->mmrtree.
+// Finding the region that holds an address, as every mmap
+// page fault does, takes O(log n) steps; p->mmrhint remembers
+// the last region found, since faults come in runs.
+//
+// Only a process itself changes its tree, in mmap(),
+// munmap(), madvise() and exit(), except that fork() builds
+// the tree of a child that can't run yet.  So no lock.
+//
+// Interface:
+// * mmrfind(p, va) returns the region holding va.
+// * mmrnext(p, va) returns the lowest region ending above va;
+//     for(m = mmrnext(p, 0); m; m = mmrnext(p, m->addr + m->length))
+//     visits all of p's regions in address order.
+// * mmrinsert() and mmrdelete() add and remove regions, which
+//     come from mmralloc() and go back with mmrfree().
+// * mmrsplit() and mmrmerge() cut a region in two and join
+//     neighbouring regions that map alike.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "slab.h"
+
+struct objcache mmrcache;
+
+void
+mmrinit(void)
+{
+  objcache_init(&mmrcache, "mmr", sizeof(struct mmr));
+}
+
+// Allocate a zeroed region.  Returns 0 if out of memory.
+struct mmr *
+mmralloc(void)
+{
+  struct mmr *m;
+
+  if((m = objalloc(&mmrcache)) != 0)
+    memset(m, 0, sizeof(*m));
+  return m;
+}
+
+void
+mmrfree(struct mmr *m)
+{
+  objfree(&mmrcache, m);
+}
+
+static int
+height(struct mmr *m)
+{
+  return m ? m->height : 0;
+}
+
+static void
+fixheight(struct mmr *m)
+{
+  int l = height(m->left), r = height(m->right);
+
+  m->height = 1 + (l > r ? l : r);
+}
+
+static struct mmr *
+rotateright(struct mmr *m)
+{
+  struct mmr *l = m->left;
+
+  m->left = l->right;
+  l->right = m;
+  fixheight(m);
+  fixheight(l);
+  return l;
+}
+
+static struct mmr *
+rotateleft(struct mmr *m)
+{
+  struct mmr *r = m->right;
+
+  m->right = r->left;
+  r->left = m;
+  fixheight(m);
+  fixheight(r);
+  return r;
+}
+
+// Restore the AVL property at m, whose subtrees differ in
+// height by at most two, and return the new subtree root.
+static struct mmr *
+balance(struct mmr *m)
+{
+  fixheight(m);
+  if(height(m->left) > height(m->right) + 1){
+    if(height(m->left->right) > height(m->left->left))
+      m->left = rotateleft(m->left);
+    return rotateright(m);
+  }
+  if(height(m->right) > height(m->left) + 1){
+    if(height(m->right->left) > height(m->right->right))
+      m->right = rotateright(m->right);
+    return rotateleft(m);
+  }
+  return m;
+}
+
+static struct mmr *
+insert(struct mmr *t, struct mmr *m)
+{
+  if(t == 0){
+    m->left = m->right = 0;
+    m->height = 1;
+    return m;
+  }
+  if(m->addr < t->addr)
+    t->left = insert(t->left, m);
+  else
+    t->right = insert(t->right, m);
+  return balance(t);
+}
+
+// Unlink the lowest region of t into *min.
+static struct mmr *
+removemin(struct mmr *t, struct mmr **min)
+{
+  if(t->left == 0){
+    *min = t;
+    return t->right;
+  }
+  t->left = removemin(t->left, min);
+  return balance(t);
+}
+
+static struct mmr *
+delete(struct mmr *t, struct mmr *m)
+{
+  struct mmr *min;
+
+  if(t == 0)
+    panic("mmrdelete");
+  if(m->addr < t->addr){
+    t->left = delete(t->left, m);
+  } else if(m->addr > t->addr){
+    t->right = delete(t->right, m);
+  } else {
+    if(t != m)
+      panic("mmrdelete");
+    if(t->right == 0)
+      return t->left;
+    t->right = removemin(t->right, &min);
+    min->left = t->left;
+    min->right = t->right;
+    t = min;
+  }
+  return balance(t);
+}
+
+// Add m to p's regions.  It must not overlap any of them.
+void
+mmrinsert(struct proc *p, struct mmr *m)
+{
+  p->mmrtree = insert(p->mmrtree, m);
+  p->nmmr++;
+}
+
+// Take m out of p's regions; the caller frees it.
+void
+mmrdelete(struct proc *p, struct mmr *m)
+{
+  p->mmrtree = delete(p->mmrtree, m);
+  p->nmmr--;
+  if(p->mmrhint == m)
+    p->mmrhint = 0;
+}
+
+// Return the region of p that holds va, or 0.
+struct mmr *
+mmrfind(struct proc *p, uint64 va)
+{
+  struct mmr *m;
+
+  m = p->mmrhint;
+  if(m && va >= m->addr && va < m->addr + m->length)
+    return m;
+  for(m = p->mmrtree; m; ){
+    if(va < m->addr)
+      m = m->left;
+    else if(va >= m->addr + m->length)
+      m = m->right;
+    else {
+      p->mmrhint = m;
+      return m;
+    }
+  }
+  return 0;
+}
+
+// Return the lowest region of p that ends above va, that is
+// the region holding va or else the first one above it, or 0.
+struct mmr *
+mmrnext(struct proc *p, uint64 va)
+{
+  struct mmr *m, *best = 0;
+
+  for(m = p->mmrtree; m; ){
+    if(va < m->addr + m->length){
+      best = m;
+      m = m->left;
+    } else {
+      m = m->right;
+    }
+  }
+  return best;
+}
+
+// Split m at addr, a page boundary inside it, so that m
+// ends at addr and a new region maps the rest alike.  A
+// megapage across addr is split too, so that no megapage
+// spans two regions and uvmunmap() of a region can't fail.
+// Returns the new region, or 0 if p has too many regions
+// or memory is exhausted.
+struct mmr *
+mmrsplit(struct proc *p, struct mmr *m, uint64 addr)
+{
+  struct mmr *n;
+
+  if(addr <= m->addr || addr >= m->addr + m->length || addr % PGSIZE)
+    panic("mmrsplit");
+  if(p->nmmr >= MAX_MMR || (n = mmralloc()) == 0)
+    return 0;
+  if(uvmsplit(p->pagetable, addr) < 0){
+    mmrfree(n);
+    return 0;
+  }
+  *n = *m;
+  n->addr = addr;
+  n->length = m->addr + m->length - addr;
+  n->offset += addr - m->addr;
+  if(n->file)
+    filedup(n->file);
+  m->length = addr - m->addr;
+  mmrinsert(p, n);
+  return n;
+}
+
+// Can a, which ends where b starts, and b be one region?
+static int
+mergeable(struct mmr *a, struct mmr *b)
+{
+  return a->addr + a->length == b->addr && a->prot == b->prot &&
+    a->flags == b->flags && a->advice == b->advice && a->file == b->file &&
+    (a->file == 0 || a->offset + a->length == b->offset);
+}
+
+// Free b, which a has absorbed.
+static void
+absorb(struct proc *p, struct mmr *a, struct mmr *b)
+{
+  a->length += b->length;
+  mmrdelete(p, b);
+  if(b->file)
+    fileclose(b->file);
+  mmrfree(b);
+}
+
+// Merge m with the regions just below and above it if they
+// map alike.  Returns the region that now holds m's range.
+struct mmr *
+mmrmerge(struct proc *p, struct mmr *m)
+{
+  struct mmr *n;
+
+  if(m->addr > 0 && (n = mmrfind(p, m->addr - 1)) != 0 && mergeable(n, m)){
+    absorb(p, n, m);
+    m = n;
+  }
+  if((n = mmrfind(p, m->addr + m->length)) != 0 && mergeable(m, n))
+    absorb(p, m, n);
+  return m;
+}
@@ -1,26 +1,51 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (MAXOPBLOCKS*3)  // fewest buffers the disk block cache keeps
+#define BCACHELOW   128  // free pages below which the block cache gives pages back
+#define BCACHEHIGH  256  // free pages above which the block cache may take more
 #define FSSIZE       1000  // size of file system in blocks
+#define READAHEAD    32  // most blocks readi() reads ahead of a sequential reader
 #define MAXPATH      128   // maximum file path name
+#define TIMEFREQ 10000000  // CLINT mtime cycles per second (qemu virt)
+#define TICKCYCLES (TIMEFREQ / 10) // mtime cycles per clock tick
+#define NSPERCYCLE (1000000000 / TIMEFREQ) // nanoseconds per mtime cycle
 #define TSTICKSHIGH  1     // ticks per time slice for HIGH queue
 #define TSTICKSMEDIUM 50   // ticks per time slice for MEDIUM queue
 #define TSTICKSLOW 200     // ticks per time slice for LOW queue
+#define ALLOTHIGH 5        // ticks a process may use at HIGH before it moves to MEDIUM
+#define ALLOTMEDIUM 250    // ticks a process may use at MEDIUM before it moves to LOW
+#define BOOSTTICKS 100     // ticks between moves of every process back to HIGH
 #define NQUEUE 3           // Number of queues for MLFQ scheduler
 #define HIGH 0             // High priority for scheduling
 #define MEDIUM 1
 #define LOW 2
 #define MLFQ 1             // 0 for RR, 1 for MLFQ
 #define RR 0
-#define MAX_MMR 10         // maximum number of memory-mapped regions per process
+#define STRIDE 2           // proportional share: stride scheduling by tickets
+#define STRIDETICKETS 100  // tickets a process starts with under STRIDE
+#define MAXTICKETS 10000   // most tickets settickets() gives one process
+#define SCHED_RT 0         // scheduling class: FIFO, runs ahead of and preempts the others
+#define SCHED_NORMAL 1     // scheduling class: RR, MLFQ or STRIDE, as set by setpolicy()
+#define SCHED_BATCH 2      // scheduling class: runs only when no other class is runnable
+#define MAX_MMR 4096       // maximum number of memory-mapped regions per process
+#define FAULTAROUND 16     // pages mapped per mmap fault, an aligned window (power of 2)
+#define FAULTAHEAD 64      // pages mapped from the fault on for MADV_SEQUENTIAL regions
+#define NPCPAGE 256        // pages of file data kept in the page cache for mmap
 #define NSEM 100           // max open semaphores per system
+#define KCACHEBATCH 32     // pages moved at once between a per-CPU cache and the global pool
+#define KCACHEMAX 128      // max free pages held in one per-CPU cache
+#define NKSTACKIDLE 64     // free kernel stack slots that keep their pages mapped
+#define NZEROPG 64         // pre-zeroed pages kept ready for kzalloc()
+#define NORDER 10          // buddy allocator block orders 0..NORDER-1 (4 KiB .. 2 MiB)
+#ifndef KJUNK
+#define KJUNK 1            // 1 to fill pages with junk in kalloc/kfree; make KFAST=1 sets 0
+#endif
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
\ No newline at end of file
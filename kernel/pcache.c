@@ -0,0 +1,219 @@
+// Page cache: whole pages of file data for mmap().
+//
+// A cached page holds PGSIZE bytes of one file, starting at
+// a page-aligned offset, and is named by the file's device
+// and inode number so that it doesn't pin an in-memory inode.
+// Every mapping of a file maps the cached pages themselves:
+// MAP_SHARED mappings writably, MAP_PRIVATE ones copy-on-write.
+//
+// The cache holds one reference to each of its pages and
+// every mapping of a page holds another (see kdup()), so a
+// page stays in memory for as long as anyone maps it.  Once
+// only the cache refers to a page it may be evicted, least
+// recently used first, to keep the cache under NPCPAGE pages.
+//
+// Interface:
+// * pcget(ip, off) returns the cached page for ip at off,
+//     reading it in if needed, with a reference for the caller.
+// * writei() calls pcwrite() so that cached pages, and so all
+//     mappings, see data written to the file.
+// * itrunc() calls pcdrop() to forget a file's pages.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
+
+#define NPCHASH 61
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;               // file offset of the page's first byte
+  char *pa;               // the page
+  struct pcpage *next;    // hash chain
+  struct pcpage *lprev;   // LRU list, most recently used first
+  struct pcpage *lnext;
+};
+
+struct {
+  struct spinlock lock;
+  struct objcache cache;
+  struct pcpage *hash[NPCHASH];
+  struct pcpage lru;      // head of the circular LRU list
+  int n;                  // pages in the cache
+} pcache;
+
+#define PCHASH(dev, inum, off) (((dev) + (inum)*31 + (off)/PGSIZE) % NPCHASH)
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  objcache_init(&pcache.cache, "pcpage", sizeof(struct pcpage));
+  pcache.lru.lprev = pcache.lru.lnext = &pcache.lru;
+}
+
+// Find a cached page.  pcache.lock must be held.
+static struct pcpage *
+pclookup(uint dev, uint inum, uint off)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.hash[PCHASH(dev, inum, off)]; pg; pg = pg->next)
+    if(pg->dev == dev && pg->inum == inum && pg->off == off)
+      return pg;
+  return 0;
+}
+
+// Move pg to the front of the LRU list.
+// pcache.lock must be held.
+static void
+pctouch(struct pcpage *pg)
+{
+  pg->lprev->lnext = pg->lnext;
+  pg->lnext->lprev = pg->lprev;
+  pg->lnext = pcache.lru.lnext;
+  pg->lprev = &pcache.lru;
+  pcache.lru.lnext->lprev = pg;
+  pcache.lru.lnext = pg;
+}
+
+// Take pg out of the cache and drop the cache's reference
+// to its page.  pcache.lock must be held.
+static void
+pcremove(struct pcpage *pg)
+{
+  struct pcpage **pp;
+
+  for(pp = &pcache.hash[PCHASH(pg->dev, pg->inum, pg->off)]; *pp != pg; pp = &(*pp)->next)
+    ;
+  *pp = pg->next;
+  pg->lprev->lnext = pg->lnext;
+  pg->lnext->lprev = pg->lprev;
+  pcache.n--;
+  kfree(pg->pa);
+  objfree(&pcache.cache, pg);
+}
+
+// Evict the least recently used page that no one maps.
+// Returns 0 if every cached page is mapped somewhere.
+// pcache.lock must be held.
+static int
+pcevict(void)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.lru.lprev; pg != &pcache.lru; pg = pg->lprev){
+    if(krefcnt(pg->pa) == 1){
+      pcremove(pg);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Return the page holding ip's data from off, which must be
+// page-aligned, with a reference that the caller gives back
+// with kfree().  Bytes past the end of the file read as zero.
+// Locks ip to read the page in, unless the caller holds it
+// already.  The caller must hold no other inode's lock, and
+// read() and write() fault in their buffers before locking
+// the file so as not to come here (see uvmprefault()).
+// Returns 0 if out of memory.
+char *
+pcget(struct inode *ip, uint off)
+{
+  struct pcpage *pg;
+  char *pa;
+  int locked;
+
+  if(off % PGSIZE)
+    panic("pcget");
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    kdup(pg->pa);
+    pctouch(pg);
+    release(&pcache.lock);
+    return pg->pa;
+  }
+  release(&pcache.lock);
+
+  if((pa = kzalloc()) == 0)
+    return 0;
+
+  // hold ip's lock until the page is in the cache, so that a
+  // writei() can't slip in between and miss it.
+  if((locked = holdingsleep(&ip->lock)) == 0)
+    ilock(ip);
+  readi(ip, 0, (uint64)pa, off, PGSIZE);
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, off)) != 0){
+    // another process read it in meanwhile.
+    kdup(pg->pa);
+    pctouch(pg);
+    release(&pcache.lock);
+    if(!locked)
+      iunlock(ip);
+    kfree(pa);
+    return pg->pa;
+  }
+  if((pcache.n < NPCPAGE || pcevict()) &&
+     (pg = objalloc(&pcache.cache)) != 0){
+    pg->dev = ip->dev;
+    pg->inum = ip->inum;
+    pg->off = off;
+    pg->pa = pa;
+    pg->next = pcache.hash[PCHASH(pg->dev, pg->inum, off)];
+    pcache.hash[PCHASH(pg->dev, pg->inum, off)] = pg;
+    pg->lnext = pcache.lru.lnext;
+    pg->lprev = &pcache.lru;
+    pcache.lru.lnext->lprev = pg;
+    pcache.lru.lnext = pg;
+    pcache.n++;
+    kdup(pa);
+  }
+  // otherwise the caller gets a page of its own.
+  release(&pcache.lock);
+  if(!locked)
+    iunlock(ip);
+  return pa;
+}
+
+// writei() wrote n bytes from src to ip at off; copy them into
+// the cached page, if any.  The bytes must lie in one page.
+void
+pcwrite(struct inode *ip, uint off, char *src, uint n)
+{
+  struct pcpage *pg;
+
+  acquire(&pcache.lock);
+  if((pg = pclookup(ip->dev, ip->inum, PGROUNDDOWN(off))) != 0)
+    memmove(pg->pa + off % PGSIZE, src, n);
+  release(&pcache.lock);
+}
+
+// Forget all of ip's cached pages, because it is being
+// truncated.  Pages that are still mapped stay with their
+// mappings.
+void
+pcdrop(struct inode *ip)
+{
+  struct pcpage *pg, *next;
+
+  acquire(&pcache.lock);
+  for(int i = 0; i < NPCHASH; i++){
+    for(pg = pcache.hash[i]; pg; pg = next){
+      next = pg->next;
+      if(pg->dev == ip->dev && pg->inum == ip->inum)
+        pcremove(pg);
+    }
+  }
+  release(&pcache.lock);
+}
@@ -7,11 +7,42 @@
 #include "defs.h"
 #include "pstat.h"
 #include "stat.h"
+#include "slab.h"
 //#include <string.h>
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// The process table.  A struct proc is allocated from
+// proccache when a process is created, up to NPROC of them,
+// and freed when its parent wait()s for it.  Every process is
+// on allproc, for the few things that must look at them all,
+// and on a chain of pidhash, to find it by pid; a parent
+// finds its children on its own p->children list.
+//
+// A process's kernel stack lives in a KSTACK() slot, with an
+// unmapped guard page below it.  Up to NKSTACKIDLE free slots
+// keep their pages mapped for the next processes.  Past that,
+// a freed slot is unmapped, and it and its page wait on
+// kstackdead until every hart has flushed its TLB (see
+// kstackflush()), instead of for a synchronous shootdown.
+#define NPIDHASH 251
+
+struct objcache proccache;
+struct proc *allproc;           // linked through p->allnext
+struct proc *pidhash[NPIDHASH]; // linked through p->pidnext
+int nproc;                      // processes in the table
+uint64 kstackmap[NPROC/64];     // bit set if the slot is in use or on kstackdead
+uint64 kstackpg[NPROC/64];      // bit set if the slot has a page mapped
+int nkstackidle;                // free slots with a page mapped
+struct kstackdead {             // in an unmapped slot's page
+  struct kstackdead *next;
+  int slot;
+} *kstackdead;
+volatile uint64 kstackgen;      // bumped when a slot is unmapped
+
+// protects allproc, pidhash, nproc and the kstack variables.
+// must be acquired before any p->lock.
+struct spinlock proc_lock;
 
 struct proc *initproc;
 
@@ -20,56 +51,95 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void procfree(struct proc *p);
+static void ipi(int cpu);
 
-static int enqueue_at_tail(struct proc *p, int priority);
+static int enqueue_at_tail(struct proc *p);
 
-static int enqueue_at_head(struct proc *p, int priority);
-static struct proc *dequeue(int priority);
+static int enqueue_at_head(struct proc *p);
+static struct proc *dequeue(int cpu, int level);
+static struct proc *runqget(int cpu);
+static struct proc *steal(int cpu);
+static void idle(struct cpu *c);
+static void wakecpu(struct proc *p);
+static void boostcheck(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
-struct queue queue[NQUEUE];
-
-int sched_policy = RR; // Should be set to RR or MLFQ
+// Run queue levels, highest first: the real-time class, the
+// MLFQ levels HIGH to LOW of the normal class (RR uses just
+// HIGH), then the batch class.
+#define QRT 0
+#define QNORMAL 1
+#define QBATCH (QNORMAL + NQUEUE)
+#define NLEVEL (QBATCH + 1)
+
+// Per-CPU run queues.  A RUNNABLE process waits on the
+// queues of the CPU it last ran on, p->cpu, so that it tends
+// to run where its cache is warm; a CPU with nothing queued
+// steals from the CPU with the most queued processes.
+struct runq {
+  struct queue queue[NLEVEL];
+  int nready; // processes on queue[]; may be read without the locks
+} runq[NCPU];
+
+// Normal-class processes under the STRIDE policy wait on one
+// queue shared by all CPUs, and each pick takes the one with
+// the lowest pass among them all: per-CPU queues can't keep
+// to ticket ratios once every CPU is busy, as nothing then
+// gets stolen.  vtime is the pass of the process picked last;
+// a process that joins the queue starts no lower, so it can't
+// make up for time spent asleep.
+#define STRIDE1 (1 << 20)
+
+struct {
+  struct spinlock lock;
+  struct proc *head;
+  uint64 vtime;
+  int n; // processes queued; may be read without the lock
+} strideq;
+
+// Sleeping processes wait on a table of queues hashed by
+// channel, so that wakeup() looks only at the processes that
+// may be sleeping on its channel.  A process is linked in by
+// sleep() and unlinked by the wakeup() that wakes it, or by
+// itself if something else, kill(), made it RUNNABLE.  Lock
+// order: a waitq lock, then p->lock.
+#define NWAITQ 61
+#define WAITHASH(chan) (((uint64)(chan) >> 3) % NWAITQ)
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head; // linked through p->wnext
+} waitq[NWAITQ];
+
+int sched_policy = RR; // RR, MLFQ or STRIDE, for normal-class processes; see setpolicy()
+uint boostgen;         // bumped by each priboost()
+
+// MLFQ tunables; schedlock serializes setschedparam() and setpolicy().
+struct schedparam schedparam = {
+  BOOSTTICKS,
+  {TSTICKSHIGH, TSTICKSMEDIUM, TSTICKSLOW},
+  {ALLOTHIGH, ALLOTMEDIUM, TSTICKSLOW},
+};
+struct spinlock schedlock;
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
-struct spinlock listid_lock;
 struct spinlock pid_lock;
-struct mmr_list mmr_list[NPROC+MAX_MMR];
-
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void proc_mapstacks(pagetable_t kpgtbl)
-{
-  struct proc *p;
-
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    char *pa = kalloc();
-    if (pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int)(p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-  }
-}
 
 // initialize the proc table at boot time.
 void procinit(void)
 {
-  struct proc *p;
-
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    initlock(&p->lock, "proc");
-    p->kstack = KSTACK((int)(p - proc));
-  }
+  initlock(&proc_lock, "proc_lock");
+  objcache_init(&proccache, "proc", sizeof(struct proc));
+  for (int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
 }
 
 // Must be called with interrupts disabled,
@@ -114,43 +184,193 @@ int allocpid()
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Find the process with the given pid and return it with
+// p->lock held, or return 0.  The state is checked before
+// proc_lock goes: procfree() frees an UNUSED proc under
+// proc_lock alone, but can't free one that isn't UNUSED
+// while we hold its lock.
 static struct proc *
-allocproc(void)
+findproc(int pid)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&proc_lock);
+  for (p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if (p->pid == pid)
+      break;
+  if (p)
   {
     acquire(&p->lock);
     if (p->state == UNUSED)
-    {
-      goto found;
-    }
-    else
     {
       release(&p->lock);
+      p = 0;
     }
   }
-  return 0;
+  release(&proc_lock);
+  return p;
+}
+
+// Free the pages on kstackdead, and their slots, if every
+// hart has flushed its TLB since they were unmapped.
+// proc_lock must be held.
+static void
+kstackreap(void)
+{
+  struct kstackdead *d;
+
+  if (kstackdead == 0)
+    return;
+  for (int i = 0; i < NCPU; i++)
+    if (cpus[i].online && cpus[i].kgen != kstackgen)
+      return;
+  while ((d = kstackdead) != 0)
+  {
+    kstackdead = d->next;
+    kstackmap[d->slot / 64] &= ~(1UL << (d->slot % 64));
+    kfree((void *)d);
+  }
+}
+
+// Flush this hart's TLB if a kernel stack slot has been
+// unmapped since it last did.  Called by scheduler() and on
+// timer interrupts, with interrupts off.
+void
+kstackflush(void)
+{
+  struct cpu *c = mycpu();
+  uint64 gen = kstackgen;
+
+  if (c->kgen != gen)
+  {
+    __sync_synchronize();
+    sfence_vma();
+    c->kgen = gen;
+  }
+}
+
+// Take a free kernel stack slot, preferring one that still
+// has a page mapped.  proc_lock must be held.
+// Returns the slot, or -1 if out of memory.
+static int
+kstackalloc(void)
+{
+  char *pa = 0;
+  int i, w;
+  uint64 bits;
+
+  kstackreap();
+  for (w = 0; w < NPROC / 64; w++)
+    if ((~kstackmap[w] & kstackpg[w]) != 0)
+      break;
+  if (w < NPROC / 64)
+  {
+    bits = ~kstackmap[w] & kstackpg[w];
+    nkstackidle--;
+  }
+  else
+  {
+    for (w = 0; w < NPROC / 64; w++)
+      if (~kstackmap[w] != 0)
+        break;
+    if (w == NPROC / 64 || (pa = kalloc()) == 0)
+      return -1;
+    bits = ~kstackmap[w];
+  }
+  for (i = 0; (bits & (1UL << i)) == 0; i++)
+    ;
+  i += w * 64;
+  if ((kstackpg[i / 64] & (1UL << (i % 64))) == 0)
+  {
+    kvmmapstack(KSTACK(i), (uint64)pa);
+    kstackpg[i / 64] |= 1UL << (i % 64);
+  }
+  kstackmap[i / 64] |= 1UL << (i % 64);
+  return i;
+}
+
+// Give back the slot of the kernel stack at va.  It keeps its
+// page if fewer than NKSTACKIDLE free slots do; otherwise the
+// page is unmapped and put on kstackdead, and parked harts are
+// woken to flush their TLBs.  proc_lock must be held.
+static void
+kstackfree(uint64 va)
+{
+  struct kstackdead *d;
+  int i = (TRAMPOLINE - va) / (2 * PGSIZE) - 1;
+
+  if (nkstackidle < NKSTACKIDLE)
+  {
+    kstackmap[i / 64] &= ~(1UL << (i % 64));
+    nkstackidle++;
+    return;
+  }
+  d = (struct kstackdead *)kvmunmapstack(va);
+  kstackpg[i / 64] &= ~(1UL << (i % 64));
+  d->slot = i;
+  d->next = kstackdead;
+  kstackdead = d;
+  __sync_synchronize();
+  kstackgen++;
+  for (int c = 0; c < NCPU; c++)
+    if (cpus[c].idle)
+      ipi(c);
+}
 
-found:
+// Allocate a proc and its kernel stack and add it to the
+// table.  If that works, initialize state required to run in
+// the kernel, and return with p->lock held.
+// If the table is full, or a memory allocation fails, return 0.
+static struct proc *
+allocproc(void)
+{
+  struct proc *p;
+  int slot;
+
+  if ((p = objalloc(&proccache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
   p->pid = allocpid();
+
+  // in the table, but UNUSED until set up.
+  acquire(&proc_lock);
+  if (nproc >= NPROC || (slot = kstackalloc()) < 0)
+  {
+    release(&proc_lock);
+    objfree(&proccache, p);
+    return 0;
+  }
+  p->kstack = KSTACK(slot);
+  nproc++;
+  if ((p->allnext = allproc) != 0)
+    allproc->allprev = &p->allnext;
+  p->allprev = &allproc;
+  allproc = p;
+  p->pidnext = pidhash[p->pid % NPIDHASH];
+  pidhash[p->pid % NPIDHASH] = p;
+  release(&proc_lock);
+
+  acquire(&p->lock);
   p->state = USED;
   p->cputime = 0;
   p->priority = HIGH;
-  p->timeslice = TSTICKSHIGH;
-  p->yielded = 0;
+  p->boosted = boostgen;
+  p->timeslice = timeslice(HIGH);
+  p->allotted = 0;
   p->next = 0;
+  p->cpu = 0;
+  p->class = SCHED_NORMAL;
+  p->tickets = STRIDETICKETS;
+  p->stride = STRIDE1 / STRIDETICKETS;
+  p->pass = 0;
 
   // Allocate a trapframe page.
   if ((p->trapframe = (struct trapframe *)kalloc()) == 0)
   {
     freeproc(p);
     release(&p->lock);
+    procfree(p);
     return 0;
   }
 
@@ -160,6 +380,7 @@ found:
   {
     freeproc(p);
     release(&p->lock);
+    procfree(p);
     return 0;
   }
 
@@ -181,49 +402,19 @@ freeproc(struct proc *p)
   if (p->trapframe)
     kfree((void *)p->trapframe);
   p->trapframe = 0;
-  int dofree = 0;
-
-  for (int i = 0; i < MAX_MMR; i++) {
-
-  dofree = 0;
-
-  if (p->mmr[i].valid == 1) {
-
-  if (p->mmr[i].flags & MAP_PRIVATE){
-    dofree = 1;
+  struct mmr *m;
+
+  // Remove region mappings from page table. Every page holds a
+  // reference for each mapping, so it goes with its last one.
+  while ((m = p->mmrtree) != 0) {
+    uvmunmap(p->pagetable, m->addr, m->length/PGSIZE, 1);
+    mmrdelete(p, m);
+    mmrfree(m);
   }
-
-  else { // MAP_SHARED
-    acquire(&mmr_list[p->mmr[i].mmr_family.listid].lock);
-
-  if (p->mmr[i].mmr_family.next == &(p->mmr[i].mmr_family)) { // no other family members
-    dofree = 1;
-    release(&mmr_list[p->mmr[i].mmr_family.listid].lock);
-    dealloc_mmr_listid(p->mmr[i].mmr_family.listid);
-
-  } else { // remove p from mmr family
-    (p->mmr[i].mmr_family.next)->prev = p->mmr[i].mmr_family.prev;
-    (p->mmr[i].mmr_family.prev)->next = p->mmr[i].mmr_family.next;
-    release(&mmr_list[p->mmr[i].mmr_family.listid].lock);
-  }
-
-  }
-
-  // Remove region mappings from page table
-
-  for (uint64 addr = p->mmr[i].addr; addr < p->mmr[i].addr + p->mmr[i].length; addr += PGSIZE)
-    if (walkaddr(p->pagetable, addr))
-      uvmunmap(p->pagetable, addr, 1, dofree);
-
-  }
-  
-
-}
   if (p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
@@ -232,6 +423,28 @@ freeproc(struct proc *p)
   p->state = UNUSED;
 }
 
+// Take p, emptied by freeproc(), out of the table, and free
+// it and its kernel stack slot.  p->lock must not be held, and p
+// must no longer be anyone's child.
+static void
+procfree(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&proc_lock);
+  for (pp = &pidhash[p->pid % NPIDHASH]; *pp != p; pp = &(*pp)->pidnext)
+    ;
+  *pp = p->pidnext;
+  if (p->allnext)
+    p->allnext->allprev = p->allprev;
+  *p->allprev = p->allnext;
+  nproc--;
+  kstackfree(p->kstack);
+  release(&proc_lock);
+
+  objfree(&proccache, p);
+}
+
 // Create a user page table for a given process,
 // with no user memory, but with trampoline pages.
 pagetable_t
@@ -310,26 +523,30 @@ void userinit(void)
   p->cwd = namei("/");
 
   p->state = RUNNABLE;
-  enqueue_at_head(p, p->priority); // Enqueue to tail
+  enqueue_at_head(p);
   // printf("userinit\n");
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
+// Growing only moves p->sz; vmfault() allocates each page
+// the first time it is touched.
 // Return 0 on success, -1 on failure.
 int growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if (n > 0)
   {
-    if ((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
+    // the heap may not run into the mapped regions.
+    if (sz + n > p->cur_max)
     {
       return -1;
     }
+    sz += n;
   }
   else if (n < 0)
   {
@@ -353,15 +570,21 @@ int fork(void)
     return -1;
   }
 
-  // Copy user memory from parent to child.
+  // Share user memory with the child, copy-on-write.
   if (uvmcopy(p->pagetable, np->pagetable, 0, p->sz) < 0)
   {
     freeproc(np);
     release(&np->lock);
+    procfree(np);
     return -1;
   }
   np->sz = p->sz;
   np->cur_max = p->cur_max;
+  np->cpu = p->cpu;
+  np->class = p->class;
+  np->tickets = p->tickets;
+  np->stride = p->stride;
+  np->pass = p->pass;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -379,93 +602,52 @@ int fork(void)
 
   pid = np->pid;
 
-  // Copy mmr table from parent to child
-
-memmove((char*)np->mmr, (char *)p->mmr, MAX_MMR*sizeof(struct mmr));
-
-// For each valid mmr, copy memory from parent to child, allocating new memory for
-
-// private regions but not for shared regions, and add child to family for shared regions.
-
-for (int i = 0; i < MAX_MMR; i++) {
-
-if(p->mmr[i].valid == 1) {
-
-if(p->mmr[i].flags & MAP_PRIVATE) {
-
-for (uint64 addr = p->mmr[i].addr; addr < p->mmr[i].addr+p->mmr[i].length; addr += PGSIZE)
-
-if(walkaddr(p->pagetable, addr))
-
-if(uvmcopy(p->pagetable, np->pagetable, addr, addr+PGSIZE) < 0) {
-
-freeproc(np);
-
-release(&np->lock);
-
-return -1;
-
-}
-
-np->mmr[i].mmr_family.proc = np;
-
-np->mmr[i].mmr_family.listid = -1;
-
-np->mmr[i].mmr_family.next = &(np->mmr[i].mmr_family);
-
-np->mmr[i].mmr_family.prev = &(np->mmr[i].mmr_family);
-
-} else { // MAP_SHARED
-
-for (uint64 addr = p->mmr[i].addr; addr < p->mmr[i].addr+p->mmr[i].length; addr += PGSIZE)
-
-if(walkaddr(p->pagetable, addr))
-
-if(uvmcopyshared(p->pagetable, np->pagetable, addr, addr+PGSIZE) < 0) {
-
-freeproc(np);
-
-release(&np->lock);
-
-return -1;
-
-}
-
-// add child process np to family for this mapped memory region
-
-np->mmr[i].mmr_family.proc = np;
-
-np->mmr[i].mmr_family.listid = p->mmr[i].mmr_family.listid;
-
-acquire(&mmr_list[p->mmr[i].mmr_family.listid].lock);
-
-np->mmr[i].mmr_family.next = p->mmr[i].mmr_family.next;
-
-p->mmr[i].mmr_family.next = &(np->mmr[i].mmr_family);
-
-np->mmr[i].mmr_family.prev = &(p->mmr[i].mmr_family);
-
-if (p->mmr[i].mmr_family.prev == &(p->mmr[i].mmr_family))
-
-p->mmr[i].mmr_family.prev = &(np->mmr[i].mmr_family);
-
-release(&mmr_list[p->mmr[i].mmr_family.listid].lock);
-
-}
-
-}
+  // Give the child a copy of each region, sharing its memory:
+  // copy-on-write for private regions, writable for shared ones.
+  // A region joins the child's tree only once it is set up, so
+  // that freeproc() on failure unmaps just what was mapped.
+  for (struct mmr *m = mmrnext(p, 0); m; m = mmrnext(p, m->addr + m->length)) {
+    struct mmr *nm;
+    int r;
+
+    if ((nm = mmralloc()) == 0) {
+      freeproc(np);
+      release(&np->lock);
+      procfree(np);
+      return -1;
+    }
+    *nm = *m;
+    if (m->flags & MAP_PRIVATE)
+      r = uvmcopy(p->pagetable, np->pagetable, m->addr, m->addr + m->length);
+    else
+      r = uvmcopyshared(p->pagetable, np->pagetable, m->addr, m->addr + m->length);
+    if (r < 0) {
+      mmrfree(nm);
+      freeproc(np);
+      release(&np->lock);
+      procfree(np);
+      return -1;
+    }
+    mmrinsert(np, nm);
+  }
 
-}
+  // The child's file regions hold their own file references.
+  for (struct mmr *m = mmrnext(np, 0); m; m = mmrnext(np, m->addr + m->length))
+    if (m->file)
+      filedup(m->file);
 
   release(&np->lock);
 
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
   release(&wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
-  enqueue_at_tail(np, np->priority);
+  enqueue_at_tail(np);
+  wakecpu(np);
   release(&np->lock);
 
   return pid;
@@ -477,14 +659,32 @@ void reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for (pp = proc; pp < &proc[NPROC]; pp++)
+  if (p->children == 0)
+    return;
+  while ((pp = p->children) != 0)
   {
-    if (pp->parent == p)
-    {
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+    p->children = pp->sibling;
+    pp->parent = initproc;
+    pp->sibling = initproc->children;
+    initproc->children = pp;
   }
+  wakeup(initproc);
+}
+
+// Take np, a ZOMBIE child of p, off p's children and free it.
+// Caller must hold wait_lock and np->lock, and gives up the
+// latter.
+static void
+reap(struct proc *p, struct proc *np)
+{
+  struct proc **pp;
+
+  for (pp = &p->children; *pp != np; pp = &(*pp)->sibling)
+    ;
+  *pp = np->sibling;
+  freeproc(np);
+  release(&np->lock);
+  procfree(np);
 }
 
 // Exit the current process.  Does not return.
@@ -497,6 +697,15 @@ void exit(int status)
   if (p == initproc)
     panic("init exiting");
 
+  // Unmap file-backed regions, writing back dirty shared pages,
+  // while the process can still sleep and the files are open.
+  uint64 va;
+  for (struct mmr *m = mmrnext(p, 0); m; m = mmrnext(p, va)) {
+    va = m->addr + m->length;
+    if (m->file)
+      munmap(m->addr, m->length);
+  }
+
   // Close all open files.
   for (int fd = 0; fd < NOFILE; fd++)
   {
@@ -538,41 +747,43 @@ void exit(int status)
 int wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, xstate = 0;
   struct proc *p = myproc();
 
+  // copyout() can't be done under the locks, and a child
+  // reaped before a failed copyout() would be lost, so check
+  // first that addr can be written, bringing its page in.
+  if (addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                           sizeof(xstate)) < 0)
+    return -1;
+
   acquire(&wait_lock);
 
   for (;;)
   {
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for (np = proc; np < &proc[NPROC]; np++)
+    for (np = p->children; np; np = np->sibling)
     {
-      if (np->parent == p)
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      havekids = 1;
+      if (np->state == ZOMBIE)
       {
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if (np->state == ZOMBIE)
-        {
-          // Found one.
-          pid = np->pid;
-          if (addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                   sizeof(np->xstate)) < 0)
-          {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
-        release(&np->lock);
+        // Found one.  copyout() may fault in a page of a
+        // mapped file, which sleeps, so reap the child and
+        // drop the locks first; addr was checked above.
+        pid = np->pid;
+        xstate = np->xstate;
+        reap(p, np);
+        release(&wait_lock);
+        if (addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                                 sizeof(xstate)) < 0)
+          return -1;
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -594,53 +805,49 @@ int
 sys_wait2(uint64 addr1, uint64 addr2)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, xstate = 0;
   struct proc *p = myproc();
-  struct rusage time;
+  struct rusage time = {0};
+
+  // as in wait(), check the addresses before reaping anything.
+  if (addr1 != 0 && copyout(p->pagetable, addr1, (char *)&xstate,
+                            sizeof(xstate)) < 0)
+    return -1;
+  if (addr2 != 0 && copyout(p->pagetable, addr2, (char *)&time,
+                            sizeof(time)) < 0)
+    return -1;
 
   acquire(&wait_lock);
 
   for (;;)
   {
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for (np = proc; np < &proc[NPROC]; np++)
+    for (np = p->children; np; np = np->sibling)
     {
-      if (np->parent == p)
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      havekids = 1;
+      if (np->state == ZOMBIE)
       {
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if (np->state == ZOMBIE)
-        {
-          // Found one.
-          pid = np->pid;
-          time.cpu_time = np->cputime;
-
-          if (addr1 != 0 && copyout(p->pagetable, addr1, (char *)&np->xstate,
-                                    sizeof(np->xstate)) < 0)
-          {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          printf("cpu time: %d\n", time.cpu_time);
-          if (addr2 != 0 && copyout(p->pagetable, addr2, (char *)&time,
-                                    sizeof(time)) < 0)
-          {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
-        release(&np->lock);
+        // Found one.  As in wait(), copy out only once the
+        // locks are gone.
+        pid = np->pid;
+        xstate = np->xstate;
+        time.cpu_time = np->cputime;
+        reap(p, np);
+        release(&wait_lock);
+
+        if (addr1 != 0 && copyout(p->pagetable, addr1, (char *)&xstate,
+                                  sizeof(xstate)) < 0)
+          return -1;
+        if (addr2 != 0 && copyout(p->pagetable, addr2, (char *)&time,
+                                  sizeof(time)) < 0)
+          return -1;
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -666,74 +873,136 @@ void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
 
   c->proc = 0;
+  c->online = 1;
   for (;;)
   {
-    if (sched_policy == RR)
+    // Avoid deadlock by ensuring that devices can interrupt.
+    intr_on();
+
+    // catch up with kernel stacks unmapped by other harts.
+    if (kstackdead)
     {
-      // Avoid deadlock by ensuring that devices can interrupt.
-      intr_on();
+      acquire(&proc_lock);
+      kstackflush();
+      kstackreap();
+      release(&proc_lock);
+    }
 
-      for (p = proc; p < &proc[NPROC]; p++)
+    p = runqget(id);
+    if (!p)
+      p = steal(id);
+    if (p)
+    {
+      acquire(&p->lock);
+      if (p->state == RUNNABLE)
       {
-        acquire(&p->lock);
-        if (p->state == RUNNABLE)
-        {
-          // Switch to chosen process.  It is the process's job
-          // to release its lock and then reacquire it
-          // before jumping back to us.
-          p->state = RUNNING;
-          c->proc = p;
-
-          swtch(&c->context, &p->context);
-
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
-          p->tsticks = 0;
-
-        }
-        release(&p->lock);
+        // Switch to chosen process.  It is the process's job
+        // to release its lock and then reacquire it
+        // before jumping back to us.
+        p->state = RUNNING;
+        p->cpu = id;
+        c->proc = p;
+        if (!c->ticking)
+          timerarm();
+
+        swtch(&c->context, &p->context);
+
+        // Process is done running for now.
+        // It should have changed its p->state before coming back.
+        c->proc = 0;
+        p->tsticks = 0;
       }
+      release(&p->lock);
     }
-    else if (sched_policy == MLFQ)
+    else
     {
-      p = dequeue(HIGH);
+      // Nothing was runnable; do some background page zeroing,
+      // or failing that, park until there is work.
+      if (!kzeroidle())
+        idle(c);
+    }
+  }
+}
 
-      if (!p)
-      {
-        p = dequeue(MEDIUM);
-      }
-      if (!p)
-      {
-        p = dequeue(LOW);
-      }
-      // printf("Pointer2: %p\n",p); // Debugging pointer
-      if (p)
-      {
-        // Avoid deadlock by ensuring that devices can interrupt.
-        intr_on();
-        acquire(&p->lock);
-        if (p->state == RUNNABLE)
-        {
-          // Switch to chosen process.  It is the process's job
-          // to release its lock and then reacquire it
-          // before jumping back to us.
-          p->state = RUNNING;
-          c->proc = p;
-
-          swtch(&c->context, &p->context);
-
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
-          p->tsticks = 0;
-        }
-        release(&p->lock);
-      }
+// Send cpu an IPI, ending its wfi in idle().
+static void
+ipi(int cpu)
+{
+  __sync_fetch_and_add(&cpus[cpu].nipi, 1);
+  *(volatile uint32 *)CLINT_MSIP(cpu) = 1;
+}
+
+// Is there anything for an idle CPU to run?  Reads without
+// locks; idle() calls it after announcing itself idle, and
+// wakecpu() looks for idle CPUs after making work, so one of
+// the two always sees the other.
+static int
+anyrunnable(void)
+{
+  if (strideq.n)
+    return 1;
+  for (int i = 0; i < NCPU; i++)
+    if (runq[i].nready)
+      return 1;
+  return 0;
+}
+
+// Nothing to run: park this CPU with wfi until an interrupt,
+// or an IPI from wakecpu().  The timer is armed only for the
+// nearest sleeper, if any, not for clock ticks.  Interrupts stay off from the
+// announcement on, so an IPI that comes before the wfi leaves
+// its software interrupt pending and the wfi falls through.
+static void
+idle(struct cpu *c)
+{
+  uint64 start;
+
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
+  if (!anyrunnable())
+  {
+    timerarm();
+    start = *(volatile uint64 *)CLINT_MTIME;
+    asm volatile("wfi");
+    c->idletime += *(volatile uint64 *)CLINT_MTIME - start;
+    c->nidle++;
+  }
+  c->idle = 0;
+  intr_on();
+}
+
+// p has just become RUNNABLE on p->cpu's queues.  Wake that
+// CPU if it is parked; if it is busy, wake some parked CPU
+// instead, which can steal p; failing that, if the busy CPU
+// runs a process of a lower class than p's, interrupt it so
+// that it gives way (see preempted()).
+// The CPU calling this is never parked.
+static void
+wakecpu(struct proc *p)
+{
+  struct proc *running;
+
+  __sync_synchronize();
+  if (cpus[p->cpu].idle)
+  {
+    ipi(p->cpu);
+    return;
+  }
+  for (int i = 0; i < NCPU; i++)
+  {
+    if (cpus[i].idle)
+    {
+      ipi(i);
+      return;
     }
   }
+  running = cpus[p->cpu].proc;
+  if (running && running != myproc() && running->class > p->class)
+    ipi(p->cpu);
 }
 
 // Switch to scheduler.  Must hold only p->lock
@@ -768,7 +1037,7 @@ void yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
-  enqueue_at_tail(p, p->priority);
+  enqueue_at_tail(p);
   // printf("yield\n");
   sched();
   release(&p->lock);
@@ -795,20 +1064,39 @@ void forkret(void)
   usertrapret();
 }
 
+// Take p off wq.  wq->lock must be held.
+static void
+waitunlink(struct waitq *wq, struct proc *p)
+{
+  struct proc **pp;
+
+  for (pp = &wq->head; *pp != p; pp = &(*pp)->wnext)
+    ;
+  *pp = p->wnext;
+  p->wnext = 0;
+  p->waitq = 0;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = &waitq[WAITHASH(chan)];
 
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // Once we are on chan's wait queue and hold
+  // p->lock, we can be guaranteed that we won't
+  // miss any wakeup (wakeup locks the queue and
+  // then p->lock), so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock); // DOC: sleeplock1
+  p->wnext = wq->head;
+  wq->head = p;
+  p->waitq = wq;
+  release(&wq->lock);
   release(lk);
 
   // Go to sleep.
@@ -819,9 +1107,18 @@ void sleep(void *chan, struct spinlock *lk)
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // kill() woke us without taking us off the queue.
+  if (p->waitq)
+  {
+    acquire(&wq->lock);
+    if (p->waitq)
+      waitunlink(wq, p);
+    release(&wq->lock);
+  }
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -829,21 +1126,26 @@ void sleep(void *chan, struct spinlock *lk)
 // Must be called without any p->lock.
 void wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = &waitq[WAITHASH(chan)];
+  struct proc *p, *next;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if (wq->head == 0)
+    return;
+  acquire(&wq->lock);
+  for (p = wq->head; p; p = next)
   {
-    if (p != myproc())
+    next = p->wnext;
+    acquire(&p->lock);
+    if (p->state == SLEEPING && p->chan == chan)
     {
-      acquire(&p->lock);
-      if (p->state == SLEEPING && p->chan == chan)
-      {
-        p->state = RUNNABLE;
-        enqueue_at_head(p, p->priority);
-      }
-      release(&p->lock);
+      waitunlink(wq, p);
+      p->state = RUNNABLE;
+      enqueue_at_head(p);
+      wakecpu(p);
     }
+    release(&p->lock);
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -853,24 +1155,18 @@ int kill(int pid)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if ((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if (p->state == SLEEPING)
   {
-    acquire(&p->lock);
-    if (p->pid == pid)
-    {
-      p->killed = 1;
-      if (p->state == SLEEPING)
-      {
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-        enqueue_at_head(p, p->priority);
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+    // Wake process from sleep().
+    p->state = RUNNABLE;
+    enqueue_at_head(p);
+    wakecpu(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -922,7 +1218,7 @@ void procdump(void)
   char *state;
 
   printf("\n");
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (p = allproc; p; p = p->allnext)
   {
     if (p->state == UNUSED)
       continue;
@@ -940,45 +1236,55 @@ int procinfo(uint64 addr)
   // return current process
   struct proc *currProc = myproc();
   struct proc *p;
+  struct pstat *ps;
+  int count = 0, n, order = 0;
 
   printf("\n");
-  int count = 0;
-  for (p = proc; p < &proc[NPROC]; p++)
+  // copyout() may sleep, so take a snapshot of the table in one
+  // pass under proc_lock, and copy it out afterwards.  allproc
+  // is newest first; fill from the end to list oldest first.
+  acquire(&proc_lock);
+  while ((PGSIZE << order) < nproc * sizeof(struct pstat))
+    order++;
+  if ((ps = kalloc_order(order)) == 0)
   {
+    release(&proc_lock);
+    return -1;
+  }
+  n = nproc;
+  for (p = allproc; p; p = p->allnext)
+  {
+    if (p->state == UNUSED)
+      continue;
+    count += 1;
+    struct pstat *thisProc = &ps[n - count];
+    thisProc->pid = p->pid;
 
-    if (p->state != UNUSED)
+    for (int i = 0; i < 16; i++)
     {
-      count += 1;
-      struct pstat thisProc;
-      thisProc.pid = p->pid;
-
-      for (int i = 0; i < 16; i++)
-      {
-        thisProc.name[i] = p->name[i];
-      }
-      thisProc.state = p->state;
-      thisProc.size = p->sz;
-      thisProc.cpu_time = p->cputime;
-      if (p->parent)
-      {
-        thisProc.ppid = (p->parent)->pid;
-      }
-      else
-      {
-        thisProc.ppid = 0;
-      }
-      // printf("%d %s\n", thisProc.pid, thisProc.name);
-
-      if (copyout(currProc->pagetable, addr, (char *)&thisProc, sizeof(thisProc)) < 0)
-      {
-        return -1;
-      }
-      addr = addr + sizeof(thisProc);
+      thisProc->name[i] = p->name[i];
+    }
+    thisProc->state = p->state;
+    thisProc->size = p->sz;
+    thisProc->cpu_time = p->cputime;
+    if (p->parent)
+    {
+      thisProc->ppid = (p->parent)->pid;
+    }
+    else
+    {
+      thisProc->ppid = 0;
     }
   }
+  release(&proc_lock);
+
+  if (copyout(currProc->pagetable, addr, (char *)&ps[n - count],
+              count * sizeof(struct pstat)) < 0)
+    count = -1;
+  kfree_order(ps, order);
   return count;
 }
-// Initializes scheduler queues
+// Initializes every CPU's scheduler queues
 
 // Call from main() after call to procinit()
 
@@ -987,51 +1293,264 @@ void queueinit(void)
 
   struct queue *q;
 
-  int i = 0;
-  for (q = queue; q < &queue[NQUEUE]; q++)
+  for (struct runq *rq = runq; rq < &runq[NCPU]; rq++)
   {
-    initlock(&q->lock, "queue");
-
-    if (i == 0)
-      q->timeslice = TSTICKSHIGH;
+    int i = 0;
+    for (q = rq->queue; q < &rq->queue[NLEVEL]; q++)
+    {
+      initlock(&q->lock, "queue");
+      if (i == QRT)
+        q->timeslice = 0; // runs until it blocks or yields
+      else if (i == QBATCH)
+        q->timeslice = timeslice(LOW);
+      else
+        q->timeslice = timeslice(i - QNORMAL);
+      q->head = 0;
+      q->tail = 0;
+      i++;
+    }
+    rq->nready = 0;
+  }
+  initlock(&schedlock, "sched");
+  initlock(&strideq.lock, "strideq");
+}
 
-    else if (i == 1)
-      q->timeslice = TSTICKSMEDIUM;
+int timeslice(int priority)
+{
+  if (priority >= HIGH && priority <= LOW)
+    return (schedparam.slice[priority]);
+  else
+  {
+    printf("timeslice: invalid priority %d\n", priority);
+    return (-1);
+  }
+}
 
-    else
-      q->timeslice = TSTICKSLOW;
+// Charge the running process p for a timer tick.  Under MLFQ,
+// once a normal process has used up its allotment at its
+// level, over however many time slices, it moves down a
+// level; so giving up the CPU just before each slice ends
+// doesn't keep a process at the top.  Real-time processes
+// have no slice; batch processes get LOW's.
+// Returns 1 if p should yield: its slice is over, it moved,
+// or a process of a higher class is waiting.
+int
+schedtick(struct proc *p)
+{
+  int moved = 0;
 
-    q->head = 0;
-    q->tail = 0;
-    i++;
+  acquire(&p->lock);
+  boostcheck(p);
+  p->cputime += 1;
+  p->tsticks += 1;
+  if (p->class == SCHED_NORMAL && sched_policy == STRIDE)
+    p->pass += p->stride;
+  if (p->class == SCHED_NORMAL && sched_policy == MLFQ)
+  {
+    p->allotted += 1;
+    if (p->priority < LOW && p->allotted > schedparam.allot[p->priority])
+    {
+      p->priority++;
+      p->allotted = 0;
+      p->timeslice = timeslice(p->priority);
+      moved = 1;
+    }
   }
+  release(&p->lock);
+
+  if (moved || preempted(p))
+    return (1);
+  if (p->class == SCHED_RT)
+    return (0);
+  return (p->tsticks > timeslice(p->class == SCHED_BATCH ? LOW : p->priority));
 }
 
-int timeslice(int priority)
+// Is a process of a higher class than p's waiting on the
+// queues of p's CPU?  Real-time processes preempt all others,
+// and normal ones preempt batch processes.  Reads without locks.
+int
+preempted(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+
+  if (p->class > SCHED_RT && rq->queue[QRT].head)
+    return (1);
+  if (p->class > SCHED_NORMAL && strideq.head)
+    return (1);
+  if (p->class > SCHED_NORMAL)
+    for (int i = QNORMAL; i < QBATCH; i++)
+      if (rq->queue[i].head)
+        return (1);
+  return (0);
+}
+
+// If priboost() has run since p's priority was last reset,
+// move p back to HIGH with a fresh allotment.  Called when p
+// is enqueued or ticks.  p->lock must be held.
+static void
+boostcheck(struct proc *p)
 {
-  if (priority == HIGH)
-    return (TSTICKSHIGH);
-  else if (priority == MEDIUM)
-    return (TSTICKSMEDIUM);
-  else if (priority == LOW)
+  uint gen = boostgen;
+
+  if (p->boosted != gen)
   {
-    return (TSTICKSLOW);
+    p->boosted = gen;
+    p->priority = HIGH;
+    p->allotted = 0;
+    p->timeslice = timeslice(HIGH);
   }
-  else
+}
+
+// Move every process back to HIGH with a fresh allotment, so
+// that long-running processes that sank to LOW get to run
+// among newer ones again.  Under MLFQ, clockintr() calls this
+// every schedparam.boost ticks.  Only the run queues are
+// touched here; each process picks up its new priority in
+// boostcheck() the next time it is enqueued or ticks.
+void
+priboost(void)
+{
+  struct runq *rq;
+  struct queue *hi, *q;
+
+  // first the generation, so that any process enqueued from
+  // now on goes on HIGH;
+  __sync_fetch_and_add(&boostgen, 1);
+
+  // then the processes already queued lower down.
+  for (rq = runq; rq < &runq[NCPU]; rq++)
   {
-    printf("timeslice: invalid priority %d\n", priority);
+    hi = &rq->queue[QNORMAL + HIGH];
+    for (q = &rq->queue[QNORMAL + MEDIUM]; q <= &rq->queue[QNORMAL + LOW]; q++)
+    {
+      if (q->head == 0)
+        continue;
+      acquire(&hi->lock);
+      acquire(&q->lock);
+      if (q->head)
+      {
+        if (hi->tail)
+          hi->tail->next = q->head;
+        else
+          hi->head = q->head;
+        hi->tail = q->tail;
+        q->head = q->tail = 0;
+      }
+      release(&q->lock);
+      release(&hi->lock);
+    }
+  }
+}
+
+// Copy the MLFQ tunables to *sp.
+void
+getschedparam(struct schedparam *sp)
+{
+  acquire(&schedlock);
+  *sp = schedparam;
+  release(&schedlock);
+}
+
+// Replace the MLFQ tunables with *sp.  Every slice and
+// allotment must be at least one tick.
+// Returns 0, or -1 if *sp is out of range.
+int
+setschedparam(struct schedparam *sp)
+{
+  struct runq *rq;
+
+  if (sp->boost < 0)
     return (-1);
+  for (int i = HIGH; i <= LOW; i++)
+    if (sp->slice[i] < 1 || sp->allot[i] < 1)
+      return (-1);
+
+  acquire(&schedlock);
+  schedparam = *sp;
+  for (rq = runq; rq < &runq[NCPU]; rq++)
+  {
+    for (int i = HIGH; i <= LOW; i++)
+      rq->queue[QNORMAL + i].timeslice = sp->slice[i];
+    rq->queue[QBATCH].timeslice = sp->slice[LOW];
   }
+  release(&schedlock);
+  return (0);
 }
 
-// queue[priority].lock is held on entry
+// Switch normal-class processes to policy RR, MLFQ or STRIDE,
+// and return the old policy; a policy of -1 just returns the
+// current one.  RR is MLFQ without demotion, so leaving MLFQ
+// moves everyone back to HIGH.  Processes already queued stay
+// where they are until they next run.
+int
+setpolicy(int policy)
+{
+  int old;
+
+  if (policy == -1)
+    return (sched_policy);
+  if (policy != RR && policy != MLFQ && policy != STRIDE)
+    return (-1);
+
+  acquire(&schedlock);
+  old = sched_policy;
+  sched_policy = policy;
+  release(&schedlock);
+  if (policy != MLFQ && old == MLFQ)
+    priboost();
+  return (old);
+}
+
+// Give the calling process n tickets, its share of the CPU
+// under STRIDE, and return its old number.  Children inherit
+// their parent's tickets.  Returns -1 if n is out of range.
+int
+settickets(int n)
+{
+  struct proc *p = myproc();
+  int old;
+
+  if (n < 1 || n > MAXTICKETS)
+    return (-1);
+  acquire(&p->lock);
+  old = p->tickets;
+  p->tickets = n;
+  p->stride = STRIDE1 / n;
+  release(&p->lock);
+  return (old);
+}
+
+// Put the process with the given pid, or the caller if pid
+// is 0, in scheduling class cls, and return its old class.
+// It moves to its new run queue when it next becomes RUNNABLE.
+// Returns -1 if there is no such process or class.
+int
+setclass(int pid, int cls)
+{
+  struct proc *p;
+  int old;
+
+  if (cls != SCHED_RT && cls != SCHED_NORMAL && cls != SCHED_BATCH)
+    return (-1);
+  if (pid == 0)
+    pid = myproc()->pid;
+
+  if ((p = findproc(pid)) == 0)
+    return (-1);
+  old = p->class;
+  p->class = cls;
+  release(&p->lock);
+  return (old);
+}
+
+// runq[cpu].queue[level].lock is held on entry
 
 /* Uncomment to use for debugging
 static void
-queueprint(int priority)
+queueprint(int cpu, int level)
 {
   struct proc *p;
-  p = queue[priority].head;
+  p = runq[cpu].queue[level].head;
   while (p) {
     printf("%d -> ", p->pid);
     p = p->next;
@@ -1041,215 +1560,257 @@ queueprint(int priority)
 }
 */
 
-int queue_empty(int priority)
+int queue_empty(int cpu, int level)
 {
-  if (!queue[priority].head)
+  if (!runq[cpu].queue[level].head)
     return (1);
 
   return (0);
 }
 
-// Enqueues process p at the tail of the scheduler queue with priority == priority
+// The run queue level for p: its class, and its priority
+// within the normal class.
+static int
+runlevel(struct proc *p)
+{
+  if (p->class == SCHED_RT)
+    return (QRT);
+  if (p->class == SCHED_BATCH)
+    return (QBATCH);
+  return (QNORMAL + p->priority);
+}
+
+// Put p on the STRIDE queue.  p->lock must be held.
+static void
+strideput(struct proc *p)
+{
+  acquire(&strideq.lock);
+  if (p->pass < strideq.vtime)
+    p->pass = strideq.vtime;
+  p->next = strideq.head;
+  strideq.head = p;
+  strideq.n++;
+  release(&strideq.lock);
+}
+
+// Take the process with the lowest pass off the STRIDE
+// queue, or return 0.
+static struct proc *
+strideget(void)
+{
+  struct proc *p, **pp, **min;
+
+  if (strideq.n == 0)
+    return (0);
+  acquire(&strideq.lock);
+  min = 0;
+  for (pp = &strideq.head; *pp; pp = &(*pp)->next)
+    if (min == 0 || (*pp)->pass < (*min)->pass)
+      min = pp;
+  p = 0;
+  if (min)
+  {
+    p = *min;
+    *min = p->next;
+    p->next = 0;
+    strideq.n--;
+    strideq.vtime = p->pass;
+  }
+  release(&strideq.lock);
+  return (p);
+}
+
+// Enqueues process p at the tail of its CPU's scheduler queue for its class and priority
 // p->lock should be held on entry
 
 static int
-enqueue_at_tail(struct proc *p, int priority)
+enqueue_at_tail(struct proc *p)
 {
-  if (!(p >= proc && p < &proc[NPROC]))
+  struct queue *q;
+
+  if (p == 0)
   {
     panic("enqueue_at_tail");
   }
-  if (!(priority >= 0) && (priority < NQUEUE))
+  if (p->priority < 0 || p->priority >= NQUEUE || p->cpu < 0 || p->cpu >= NCPU)
   {
     panic("enqueue_at_tail");
   }
-  acquire(&queue[priority].lock);
-  if ((queue[priority].head == 0) && (queue[priority].tail == 0))
+  boostcheck(p);
+  if (p->class == SCHED_NORMAL && sched_policy == STRIDE)
   {
-    queue[priority].head = p;
-    queue[priority].tail = p;
-    release(&queue[priority].lock);
-
+    strideput(p);
     return (0);
   }
 
-  if (queue[priority].tail == 0)
+  q = &runq[p->cpu].queue[runlevel(p)];
+  acquire(&q->lock);
+  p->next = 0;
+  if ((q->head == 0) && (q->tail == 0))
   {
-    release(&queue[priority].lock);
-    panic("enqueue_at_tail");
+    q->head = p;
+    q->tail = p;
   }
-
-  queue[priority].tail->next = p;
-  queue[priority].tail = p;
-  release(&queue[priority].lock);
+  else
+  {
+    if (q->tail == 0)
+    {
+      release(&q->lock);
+      panic("enqueue_at_tail");
+    }
+    q->tail->next = p;
+    q->tail = p;
+  }
+  __sync_fetch_and_add(&runq[p->cpu].nready, 1);
+  release(&q->lock);
   return (0);
 }
 
-// Enqueues process p at the head of the scheduler queue with priority == priority
+// Enqueues process p at the head of its CPU's scheduler queue for its class and priority
 
 // p->lock should be held on entry except for initial enqueue of init
 
 static int
-enqueue_at_head(struct proc *p, int priority)
+enqueue_at_head(struct proc *p)
 {
-  if (!(p >= proc && p < &proc[NPROC]))
+  struct queue *q;
+
+  if (p == 0)
   {
     panic("enqueue_at_head");
   }
-  if (!(priority >= 0) && (priority < NQUEUE))
+  if (p->priority < 0 || p->priority >= NQUEUE || p->cpu < 0 || p->cpu >= NCPU)
   {
     panic("enqueue_at_head");
   }
-  // printf("entered enqueue_at_head, pid = %d\n", p->pid);
-  acquire(&queue[priority].lock);
-  if ((queue[priority].head == 0) && (queue[priority].tail == 0))
+  boostcheck(p);
+  if (p->class == SCHED_NORMAL && sched_policy == STRIDE)
   {
-    queue[priority].head = p;
-    queue[priority].tail = p;
-    release(&queue[priority].lock);
+    strideput(p);
     return (0);
   }
 
-  if (queue[priority].head == 0)
+  q = &runq[p->cpu].queue[runlevel(p)];
+  acquire(&q->lock);
+  if ((q->head == 0) && (q->tail == 0))
   {
-    release(&queue[priority].lock);
-    panic("enqueue_at_head");
+    p->next = 0;
+    q->head = p;
+    q->tail = p;
   }
-
-  p->next = queue[priority].head;
-  queue[priority].head = p;
-  release(&queue[priority].lock);
+  else
+  {
+    if (q->head == 0)
+    {
+      release(&q->lock);
+      panic("enqueue_at_head");
+    }
+    p->next = q->head;
+    q->head = p;
+  }
+  __sync_fetch_and_add(&runq[p->cpu].nready, 1);
+  release(&q->lock);
   return (0);
 }
 
-// Dequeues and returns process at head of queue with priority == priority, or
+// Dequeues and returns process at head of cpu's queue at level, or
 // returns 0 in the case of an empty queue
+// Takes only the queue lock: enqueuers hold p->lock while they take it, so
+// taking p->lock here as well could deadlock
 
 static struct proc *
-dequeue(int priority)
+dequeue(int cpu, int level)
 {
   struct proc *p;
+  struct queue *q;
 
-  if (!(priority >= 0) && (priority < NQUEUE))
+  if (level < 0 || level >= NLEVEL)
   {
-    printf("dequeue: invalid argument %d\n");
+    printf("dequeue: invalid argument %d\n", level);
     return (0);
   }
 
-  acquire(&queue[priority].lock);
-  if ((queue[priority].head == 0) && (queue[priority].tail == 0))
+  q = &runq[cpu].queue[level];
+  acquire(&q->lock);
+  if ((q->head == 0) && (q->tail == 0))
   {
-    release(&queue[priority].lock);
+    release(&q->lock);
     return (0);
   }
 
-  if (queue[priority].head == 0)
+  if (q->head == 0)
   {
-    release(&queue[priority].lock);
+    release(&q->lock);
     panic("dequeue");
   }
 
-  p = queue[priority].head;
-  acquire(&p->lock);
-  queue[priority].head = p->next;
+  p = q->head;
+  q->head = p->next;
   p->next = 0;
-  release(&p->lock);
 
-  if (!queue[priority].head)
-    queue[priority].tail = 0;
+  if (!q->head)
+    q->tail = 0;
 
-  release(&queue[priority].lock);
+  __sync_fetch_and_sub(&runq[cpu].nready, 1);
+  release(&q->lock);
 
   return (p);
 }
 
-// Initialize mmr_list
-
-void
-
-mmrlistinit(void)
-
+// Take the process at the head of cpu's highest non-empty
+// queue, or return 0; the STRIDE queue ranks with the normal
+// class, ahead of its per-CPU levels.  Peeks at the counts
+// first so that a CPU with nothing queued takes no locks.
+static struct proc *
+runqget(int cpu)
 {
+  struct proc *p;
 
-struct mmr_list *pmmrlist;
-
-initlock(&listid_lock,"listid");
-
-for (pmmrlist = mmr_list; pmmrlist < &mmr_list[NPROC*MAX_MMR]; pmmrlist++) {
-
-  initlock(&pmmrlist->lock, "mmrlist");
-
-  pmmrlist->valid = 0;
-
-}
-
-}
-
-// find the mmr_list for a given listid
-
-struct mmr_list*
-
-get_mmr_list(int listid) {
-
-acquire(&listid_lock);
-
-if (listid >=0 && listid < NPROC*MAX_MMR && mmr_list[listid].valid) {
-
-  release(&listid_lock);
-  return(&mmr_list[listid]);
-
+  if (runq[cpu].nready == 0 && strideq.n == 0)
+    return (0);
+  for (int level = 0; level < NLEVEL; level++)
+  {
+    if (level == QNORMAL && (p = strideget()) != 0)
+      return (p);
+    if (runq[cpu].nready && (p = dequeue(cpu, level)) != 0)
+      return (p);
+  }
+  return (0);
 }
 
-else {
-
-  release(&listid_lock);
-
-  return 0;
-
-}
+// Nothing is queued on cpu: take a process from the CPU with
+// the most queued processes.  It runs here from now on.
+static struct proc *
+steal(int cpu)
+{
+  int i, n, busiest = -1, most = 0;
 
+  for (i = 0; i < NCPU; i++)
+  {
+    n = runq[i].nready;
+    if (i != cpu && n > most)
+    {
+      most = n;
+      busiest = i;
+    }
+  }
+  if (busiest < 0)
+    return (0);
+  return (runqget(busiest));
 }
 
-// free up entry in mmr_list array
-
+// Copy the per-CPU idle counters to *cs.
 void
-
-dealloc_mmr_listid(int listid) {
-
-  acquire(&listid_lock);
-
-  mmr_list[listid].valid = 0;
-
-  release(&listid_lock);
-
-}
-
-// find an unused entry in the mmr_list array
-
-int
-
-alloc_mmr_listid() {
-
-acquire(&listid_lock);
-
-int listid = -1;
-
-for (int i = 0; i < NPROC*MAX_MMR; i++) {
-
-  if (mmr_list[i].valid == 0) {
-
-    mmr_list[i].valid = 1;
-
-    listid = i;
-
-    break;
-
+cpustat(struct cpustat *cs)
+{
+  memset(cs, 0, sizeof(*cs));
+  cs->time = *(volatile uint64 *)CLINT_MTIME;
+  for (int i = 0; i < NCPU; i++)
+  {
+    cs->online[i] = cpus[i].online;
+    cs->idle[i] = cpus[i].idletime;
+    cs->nidle[i] = cpus[i].nidle;
+    cs->nipi[i] = cpus[i].nipi;
+    cs->ntimer[i] = cpus[i].ntimer;
   }
-
 }
-
-release(&listid_lock);
-
-return(listid);
-
-}
\ No newline at end of file
@@ -24,6 +24,16 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int online;                 // Has entered scheduler().
+  volatile int idle;          // Parked in wfi; wake with an IPI.
+  uint64 idletime;            // mtime cycles spent parked.
+  uint64 nidle;               // Times parked.
+  uint64 nipi;                // Wakeup IPIs sent to this cpu.
+  uint64 timer;               // Deadline in mtimecmp; see timerarm().
+  int ticking;                // Timer armed for clock ticks.
+  uint tick;                  // Last clock tick seen by timerintr().
+  uint64 ntimer;              // Timer interrupts taken.
+  uint64 kgen;                // kstackgen as of this hart's last TLB flush.
 };
 
 extern struct cpu cpus[NCPU];
@@ -82,34 +92,21 @@ struct trapframe {
 
 
 
-// struct with lock for list of mmr family members
-
-struct mmr_list {
-  struct spinlock lock;
-  int valid;
-};
-
-// struct for node in list of processes that share a mapped memory region
-
-struct mmr_node {
-  int listid; // index into mmr_list array with per-list locks
-  struct proc *proc; // this process so it can be found easily
-  struct mmr_node *next; // next process in family
-  struct mmr_node *prev; // previous process in family
-};
-
-// struct for a shared memory region
+// struct for a memory-mapped region, one node of its
+// process's region tree (see mmr.c)
 
 struct mmr {
   uint64 addr; // starting address of the region
-  int length; // length of the region in bytes
+  uint64 length; // length of the region in bytes
   int prot; // R/W/X permissions for pages in the region
   int flags; // MAP_ANONYMOUS, MAP_PRIVATE or MAP_SHARED
-  int valid; // 1 if this entry is in use
-  struct file *file; // not used for Lab 3
-  int fd; // not used for Lab 3
-  struct mmr_node mmr_family; // my node in the mmr family
-
+  int advice; // MADV_* hint for how many pages to map per fault
+  struct file *file; // mapped file, 0 for MAP_ANONYMOUS
+  int fd; // descriptor the file was mapped through
+  uint offset; // file offset of the region's first byte
+  struct mmr *left; // regions below this one in the tree
+  struct mmr *right; // regions above this one in the tree
+  int height; // height of the subtree rooted here
 };
 
 // Per-process state
@@ -126,14 +123,37 @@ struct proc {
   uint tsticks; // Ticks accumulated in current time slice
   int priority; // Scheduling priority (0 to NQUEUE-1)
   uint timeslice; // scheduling timeslice
-  int yielded; // 1 if this process yielded to a higher priority process before using its timeslice
+  uint allotted; // Ticks used at the current priority, over all its time slices
+  uint boosted; // boostgen when priority was last reset; see boostcheck()
   struct proc *next; // next process in scheduler queue
-
-  // wait_lock must be held when using this:
+  int cpu; // CPU whose run queues this process waits on
+  int class; // Scheduling class: SCHED_RT, SCHED_NORMAL or SCHED_BATCH
+  int tickets; // Share of the CPU under STRIDE
+  uint64 stride; // STRIDE1 / tickets, added to pass for each tick run
+  uint64 pass; // Virtual time used under STRIDE; lowest runs next
+
+  // the lock of the wait queue holding the process must be held
+  // when using these; see sleep():
+  struct waitq *waitq;         // If non-zero, wait queue of chan
+  struct proc *wnext;          // Next process on that queue
+
+  // the lock of the timer heap holding the process must be held
+  // when using these; see sleepuntil():
+  uint64 wakeat;               // If non-zero, mtime deadline of sleepuntil()
+  int timerslot;               // Index in the heap
+
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child
+  struct proc *sibling;        // Next child of the same parent
+
+  // proc_lock must be held when using these:
+  struct proc *allnext;        // Next process in the table
+  struct proc **allprev;       // Link that points to this process
+  struct proc *pidnext;        // Next process in the same pid hash chain
 
   // these are private to the process, so p->lock need not be held.
-  uint64 kstack;               // Virtual address of kernel stack
+  uint64 kstack;               // Address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
@@ -142,8 +162,10 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 
-  struct mmr mmr[MAX_MMR]; // Array of memory-mapped regions
-  uint64 cur_max; // Max address of free virtual memory,
+  struct mmr *mmrtree; // Memory-mapped regions, an AVL tree by address
+  int nmmr; // Number of regions in mmrtree
+  struct mmr *mmrhint; // Region that was found last
+  uint64 cur_max; // Start of the lowest mapped region, or TRAPFRAME
 
 };
 
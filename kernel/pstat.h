@@ -11,4 +11,58 @@ struct pstat {
 
 struct rusage{
   int cpu_time;
+};
+
+// physical page allocator counters, see kmemstat().
+// nalloc and nfree only grow; sample twice and divide
+// by the difference in ticks to get rates.
+struct memstat {
+  uint64 total;    // pages managed by the allocator
+  uint64 free;     // pages currently free
+  uint64 cached;   // free pages held in per-CPU caches
+  uint64 zeroed;   // free pages already zeroed for kzalloc()
+  uint64 hiwater;  // most pages ever allocated at once
+  uint64 nalloc;   // successful kalloc() calls since boot
+  uint64 nfree;    // kfree() calls since boot
+  uint64 nfail;    // kalloc() calls that found no memory
+  uint64 nblock[NORDER]; // free buddy blocks of 2^k pages
+  uint ticks;      // uptime when the snapshot was taken
+};
+
+// MLFQ tunables, in ticks; see getsched() and setsched().
+struct schedparam {
+  int boost;            // period of the boost of every process back to
+                        // the top level; 0 turns the boost off
+  int slice[NQUEUE];    // time slice at each level
+  int allot[NQUEUE];    // ticks a process may use at a level, however
+                        // often it gives up the CPU, before moving down
+};
+
+// per-CPU idle counters, see cpustat() in proc.c.
+// times are in CLINT mtime cycles (10 MHz in qemu); sample
+// twice and divide the change in idle by the change in
+// time to get the fraction of time each CPU sat idle.
+struct cpustat {
+  uint64 time;          // mtime when the snapshot was taken
+  int online[NCPU];     // 1 if the CPU is running scheduler()
+  uint64 idle[NCPU];    // cycles parked in wfi
+  uint64 nidle[NCPU];   // times the CPU parked
+  uint64 nipi[NCPU];    // wakeup IPIs sent to the CPU
+  uint64 ntimer[NCPU];  // timer interrupts the CPU took
+};
+
+// buffer cache counters, see bstat() in bio.c.
+// all but nbuf and nfree only grow; sample twice and
+// take differences for rates.
+struct bstat {
+  uint64 nbuf;     // buffers in the cache
+  uint64 nfree;    // buffers holding no block
+  uint64 nhit;     // bget() calls that found the block cached
+  uint64 nmiss;    // bget() calls that had to find it a buffer
+  uint64 nevict;   // misses that recycled a buffer holding another block
+  uint64 nahead;   // blocks breadahead() started reading
+  uint64 ndiskreq;   // requests sent to the disk
+  uint64 ndiskblock; // blocks those requests moved
+  uint64 ngrow;    // pages taken from kalloc()
+  uint64 nshrink;  // pages given back under memory pressure
 };
\ No newline at end of file
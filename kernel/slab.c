@@ -0,0 +1,170 @@
+// Object caches for fixed-size kernel objects
+// (struct file, struct pipe, ...).
+//
+// A slab is one page from kalloc() holding a struct slab
+// header followed by as many objects as fit.  Free objects
+// inside a slab are chained through their first word.
+// Each CPU keeps a magazine of up to MAGSIZE free objects
+// per cache, so most objalloc() and objfree() calls take no
+// lock at all; magazines refill from and flush to the slabs
+// MAGSIZE/2 objects at a time under the cache's lock.
+//
+// Interface:
+// * objcache_init(c, name, size) once at boot.
+// * objalloc(c) returns an uninitialized object, or 0.
+// * objfree(c, obj) gives it back.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "slab.h"
+
+struct slab {
+  struct objcache *cache;
+  struct slab *next;      // in cache->partial
+  struct slab *prev;
+  void *freelist;         // free objects in this slab
+  int inuse;              // objects allocated or in magazines
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+void
+objcache_init(struct objcache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7;
+  if(size < sizeof(void*) || SLABHDR + size > PGSIZE)
+    panic("objcache_init");
+
+  initlock(&c->lock, "objcache");
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  c->partial = 0;
+  c->nslab = 0;
+  for(int i = 0; i < NCPU; i++)
+    c->mag[i].n = 0;
+}
+
+static void
+partial_insert(struct objcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+partial_remove(struct objcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+// Carve a new page into a slab and put it on the partial list.
+// c->lock must be held.
+static struct slab *
+slab_grow(struct objcache *c)
+{
+  struct slab *s;
+  char *obj;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->freelist = 0;
+  s->inuse = 0;
+  obj = (char*)s + SLABHDR + (c->perslab - 1) * c->size;
+  for(int i = 0; i < c->perslab; i++, obj -= c->size){
+    *(void**)obj = s->freelist;
+    s->freelist = obj;
+  }
+  partial_insert(c, s);
+  c->nslab++;
+  return s;
+}
+
+// Return one object to its slab.  Frees the slab's page
+// once it is empty, unless it is the only partial slab.
+// c->lock must be held.
+static void
+slab_put(struct objcache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)obj);
+
+  if(s->cache != c)
+    panic("objfree: wrong cache");
+
+  if(s->freelist == 0)  // was full, so not on the partial list.
+    partial_insert(c, s);
+  *(void**)obj = s->freelist;
+  s->freelist = obj;
+  s->inuse--;
+
+  if(s->inuse == 0 && (s->prev || s->next)){
+    partial_remove(c, s);
+    c->nslab--;
+    kfree((void*)s);
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if out of memory.
+void *
+objalloc(struct objcache *c)
+{
+  struct magazine *m;
+  struct slab *s;
+  void *obj;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    // refill half the magazine from the slabs.
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2){
+      if((s = c->partial) == 0 && (s = slab_grow(c)) == 0)
+        break;
+      obj = s->freelist;
+      s->freelist = *(void**)obj;
+      s->inuse++;
+      if(s->freelist == 0)
+        partial_remove(c, s);
+      m->obj[m->n++] = obj;
+    }
+    release(&c->lock);
+  }
+  obj = 0;
+  if(m->n > 0)
+    obj = m->obj[--m->n];
+  pop_off();
+  return obj;
+}
+
+// Free an object previously returned by objalloc(c).
+void
+objfree(struct objcache *c, void *obj)
+{
+  struct magazine *m;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    // flush half the magazine back to the slabs.
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slab_put(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  pop_off();
+}
@@ -0,0 +1,21 @@
+// Object cache for fixed-size kernel objects.
+// See slab.c.
+
+#define MAGSIZE 16   // free objects held per CPU per cache
+
+// per-CPU stack of free objects, used with interrupts
+// off and so without a lock.
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct objcache {
+  struct spinlock lock;   // protects the slab lists
+  char *name;             // for debugging
+  uint size;              // object size, rounded up to 8 bytes
+  int perslab;            // objects per slab page
+  struct slab *partial;   // slabs with at least one free object
+  int nslab;              // pages the cache holds
+  struct magazine mag[NCPU];
+};
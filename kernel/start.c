@@ -11,7 +11,7 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][6];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -54,27 +54,29 @@ start()
   asm volatile("mret");
 }
 
-// set up to receive timer interrupts in machine mode,
+// set up to receive timer interrupts and IPIs in machine mode,
 // which arrive at timervec in kernelvec.S,
 // which turns them into software interrupts for
-// devintr() in trap.c.
+// devintr() in trap.c.  after the first tick, supervisor
+// mode programs mtimecmp itself (see timerarm() in timer.c).
 void
 timerinit()
 {
   // each CPU has a separate source of timer interrupts.
   int id = r_mhartid();
 
-  // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  // ask the CLINT for a first timer interrupt.
+  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + TICKCYCLES;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
-  // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[4] : address of CLINT MSIP register, for IPIs.
+  // scratch[5] : set by timervec when a timer interrupt is pending for devintr().
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
-  scratch[4] = interval;
+  scratch[4] = CLINT_MSIP(id);
+  scratch[5] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -83,6 +85,7 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer and software interrupts; the
+  // latter are IPIs that wake an idle hart (see idle() in proc.c).
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
@@ -6,6 +6,11 @@
 #define MAP_SHARED 0x01 /* Share changes */
 #define MAP_PRIVATE 0x02 /* Changes are private */
 #define MAP_ANONYMOUS 0x20 /* No associated file */
+#define MADV_NORMAL 0 /* Map a window of pages around each fault */
+#define MADV_RANDOM 1 /* Map only the page that faulted */
+#define MADV_SEQUENTIAL 2 /* Map pages ahead of each fault */
+#define FUTEX_WAIT 0 /* Sleep if the word still holds a value */
+#define FUTEX_WAKE 1 /* Wake sleepers on the word */
 
 struct stat {
   int dev;     // File system's disk device
@@ -113,6 +113,18 @@ extern uint64 sys_sem_init(void);
 extern uint64 sys_sem_destroy(void);
 extern uint64 sys_sem_wait(void);
 extern uint64 sys_sem_post(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_cpustat(void);
+extern uint64 sys_getsched(void);
+extern uint64 sys_setsched(void);
+extern uint64 sys_setpolicy(void);
+extern uint64 sys_setclass(void);
+extern uint64 sys_settickets(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_nanotime(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_bstat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -145,6 +157,18 @@ static uint64 (*syscalls[])(void) = {
 [SYS_sem_destroy] sys_sem_destroy,
 [SYS_sem_wait] sys_sem_wait,
 [SYS_sem_post] sys_sem_post,
+[SYS_memstat] sys_memstat,
+[SYS_madvise] sys_madvise,
+[SYS_cpustat] sys_cpustat,
+[SYS_getsched] sys_getsched,
+[SYS_setsched] sys_setsched,
+[SYS_setpolicy] sys_setpolicy,
+[SYS_setclass] sys_setclass,
+[SYS_settickets] sys_settickets,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_nanotime] sys_nanotime,
+[SYS_futex] sys_futex,
+[SYS_bstat] sys_bstat,
 };
 
 void
@@ -29,3 +29,15 @@
 #define SYS_sem_destroy 28
 #define SYS_sem_wait 29
 #define SYS_sem_post 30
+#define SYS_memstat 31
+#define SYS_madvise 32
+#define SYS_cpustat 33
+#define SYS_getsched 34
+#define SYS_setsched 35
+#define SYS_setpolicy 36
+#define SYS_setclass 37
+#define SYS_settickets 38
+#define SYS_nanosleep 39
+#define SYS_nanotime 40
+#define SYS_futex 41
+#define SYS_bstat 42
@@ -5,6 +5,7 @@
 //
 #include "types.h"
 #include "riscv.h"
+#include "memlayout.h"
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
@@ -74,6 +75,8 @@ sys_read(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
+  if(n > 0)
+    uvmprefault(myproc()->pagetable, p, n, 1);
   return fileread(f, p, n);
 }
 
@@ -86,7 +89,8 @@ sys_write(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
     return -1;
-
+  if(n > 0)
+    uvmprefault(myproc()->pagetable, p, n, 0);
   return filewrite(f, p, n);
 }
 
@@ -485,18 +489,30 @@ sys_pipe(void)
 }
 
 // Create a new mapped memory region
+// Without MAP_ANONYMOUS the region maps the file open on fd from offset,
+// which must be page-aligned; its pages come from the page cache
+// A non-zero addr is a hint: the region goes there if that range is free,
+// otherwise just below the lowest region, like every region without a hint
 
 uint64
 sys_mmap()
 {
+  uint64 hint;
   uint64 length;
   int prot;
   int flags;
+  int fd = -1;
+  int offset = 0;
+  struct file *f = 0;
   struct proc *p = myproc();
-  struct mmr *newmmr = 0;
-  uint64 start_addr;
+  struct mmr *newmmr;
+  struct mmr *next;
+  uint64 start_addr = 0;
 
   /* Add error checking for length, prot, and flags arguments */
+  if (argaddr(0, &hint) < 0)
+    return -1;
+
   if (argaddr(1, &length) < 0)
     return -1;
 
@@ -506,94 +522,188 @@ sys_mmap()
   if (argint(3, &flags) <0)
     return -1;
 
-  // Search p->mmr[] for unused location
-  for (int i = 0; i < MAX_MMR; i++) {
-    if (p->mmr[i].valid == 0) {
-      newmmr = &(p->mmr[i]);
-      break;
-    }
+  if (!(flags & MAP_ANONYMOUS)) {
+    if (argfd(4, &fd, &f) < 0 || argint(5, &offset) < 0)
+      return -1;
+    if (f->type != FD_INODE || !f->readable || offset < 0 || offset % PGSIZE != 0)
+      return -1;
+    if ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
   }
 
-// Fill in struct mmr fields for new mapped region
-  if (newmmr) {
-    start_addr = PGROUNDDOWN(p->cur_max - length);
-    newmmr->valid = 1;
-    newmmr->addr = start_addr;
-    newmmr->length = p->cur_max - start_addr;
-    newmmr->prot = prot;
-    newmmr->flags = flags;
-    newmmr->mmr_family.proc = p;
-    newmmr->mmr_family.next = &(newmmr->mmr_family); // next points to its own mmr_node
-    newmmr->mmr_family.prev = &(newmmr->mmr_family); // prev points to its own mmr_node
-
-    // Allocate page table pages if needed
-    if (mapvpages(p->pagetable, newmmr->addr, newmmr->length) < 0) {
-      newmmr->valid = 0;
+  if (length == 0 || length > TRAPFRAME || p->nmmr >= MAX_MMR)
+    return -1;
+  length = PGROUNDUP(length);
+
+  if (hint != 0 && hint % PGSIZE == 0 && hint >= PGROUNDUP(p->sz) &&
+      hint <= TRAPFRAME - length &&
+      ((next = mmrnext(p, hint)) == 0 || next->addr >= hint + length))
+    start_addr = hint;
+
+  if (start_addr == 0) {
+    if (length > p->cur_max - PGROUNDUP(p->sz))
       return -1;
-    }
+    // Anonymous regions of a megapage or more start on a megapage
+    // boundary so vmfault() can back them with megapages
+    start_addr = p->cur_max - length;
+    if (length >= MEGAPGSIZE && f == 0)
+      start_addr = MEGAROUNDDOWN(start_addr);
+    if (start_addr < PGROUNDUP(p->sz))
+      return -1;
+  }
 
-    if (flags & MAP_SHARED) // start an mmr_list if region is shared
-      newmmr->mmr_family.listid = alloc_mmr_listid();
-    p->cur_max = start_addr;
-    return start_addr;
-    
-  } else {
+  // Fill in struct mmr fields for new mapped region
+  if ((newmmr = mmralloc()) == 0)
     return -1;
+  newmmr->addr = start_addr;
+  newmmr->length = length;
+  newmmr->prot = prot;
+  newmmr->flags = flags;
+  newmmr->advice = MADV_NORMAL;
+  newmmr->file = f ? filedup(f) : 0;
+  newmmr->fd = fd;
+  newmmr->offset = offset;
+  mmrinsert(p, newmmr);
+  if (start_addr < p->cur_max)
+    p->cur_max = start_addr;
+
+  // Regions placed one below the other coalesce if they map alike
+  mmrmerge(p, newmmr);
+  return start_addr;
+}
+
+// Write the pages of [start, end) in a shared file mapping that
+// the hardware marked dirty back to the file, without growing it
+
+static void
+mmrwriteback(struct mmr *mmr, uint64 start, uint64 end)
+{
+  struct proc *p = myproc();
+  struct inode *ip = mmr->file->ip;
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint64 va, pa;
+  uint off, i, n;
+
+  for (va = start; va < end; va += PGSIZE) {
+    if ((pa = uvmdirty(p->pagetable, va)) == 0)
+      continue;
+    off = mmr->offset + (va - mmr->addr);
+    // a page takes more log blocks than one transaction allows,
+    // so write it in pieces, as filewrite() does
+    for (i = 0; i < PGSIZE; i += n) {
+      begin_op();
+      ilock(ip);
+      n = PGSIZE - i;
+      if (n > max)
+        n = max;
+      if (off + i >= ip->size)
+        n = 0;
+      else if (off + i + n > ip->size)
+        n = ip->size - (off + i);
+      if (n > 0)
+        writei(ip, 0, pa + i, off + i, n);
+      iunlock(ip);
+      end_op();
+      if (n == 0)
+        break;
+    }
   }
 }
 
-// Unmap memory region if it exists
-// Free physical memory if no other process has the region mapped
+// Unmap the pages of [addr, addr+length) from every region they lie in
+// A region that is only partly covered keeps the rest, split in two if need be
+// Pages are reference counted, so memory is freed with its last mapping
+// Dirty pages of a shared file mapping are written back to the file first
 
 int
 munmap(uint64 addr, uint64 length)
 {
 
   struct proc *p = myproc();
-  struct mmr *mmr = 0;
-  int dofree = 0;
-  int i;
+  struct mmr *mmr, *last;
+  uint64 end, va;
 
-  // Search proc->mmr for addr
-  for (i = 0; i < MAX_MMR; i++){
-      if ((p->mmr[i].valid == 1) && (addr == p->mmr[i].addr) &&
-      (PGROUNDUP(length) == p->mmr[i].length)) {
-        mmr = &(p->mmr[i]);
-        break;
-    }
-  }
+  if ((addr % PGSIZE) != 0 || length == 0 || addr + length < addr)
+    return -1;
+  end = addr + PGROUNDUP(length);
 
-  if (!mmr) {
+  if ((mmr = mmrnext(p, addr)) == 0 || mmr->addr >= end)
     return -1;
+
+  // Splitting can fail, so do it before anything is unmapped:
+  // keep the part of the last region above end
+  if ((last = mmrfind(p, end - 1)) != 0 && last->addr + last->length > end) {
+    if (mmrsplit(p, last, end) == 0)
+      return -1;
+  } else {
+    last = 0;
   }
 
-  mmr->valid = 0;
+  // and the part of the first region below addr, joining the
+  // last one up again if that fails
+  if (mmr->addr < addr) {
+    if ((mmr = mmrsplit(p, mmr, addr)) == 0) {
+      if (last)
+        mmrmerge(p, last);
+      return -1;
+    }
+  }
 
-  if (mmr->flags & MAP_PRIVATE)
-    dofree = 1;
-  else { // MAP_SHARED
-    struct mmr_list *pmmrlist = get_mmr_list(mmr->mmr_family.listid);
-    acquire(&pmmrlist->lock);
+  for (; mmr && mmr->addr < end; mmr = mmrnext(p, va)) {
+    va = mmr->addr + mmr->length;
 
-    if (mmr->mmr_family.next == &(mmr->mmr_family)) { // no other family members
-      dofree = 1;
-      release(&pmmrlist->lock);
-      dealloc_mmr_listid(mmr->mmr_family.listid);
+    if (mmr->file && (mmr->flags & MAP_SHARED))
+      mmrwriteback(mmr, mmr->addr, va);
 
-    } else { // remove p from mmr family
-      (mmr->mmr_family.next)->prev = mmr->mmr_family.prev;
-      (mmr->mmr_family.prev)->next = mmr->mmr_family.next;
-      release(&pmmrlist->lock);
-    }
-  }
+    // Remove mappings from page table
+    uvmunmap(p->pagetable, mmr->addr, mmr->length/PGSIZE, 1);
 
-  // Remove mappings from page table
-  // Also free physical memory if no other process has this region mapped
-  for (uint64 pageaddr = addr; pageaddr < p->mmr[i].addr+p->mmr[i].length; pageaddr += PGSIZE) {
-    if (walkaddr(p->pagetable, pageaddr)) {
-      uvmunmap(p->pagetable, pageaddr, 1, dofree);
-    }
+    mmrdelete(p, mmr);
+    if (mmr->file)
+      fileclose(mmr->file);
+    mmrfree(mmr);
   }
+
+  // Address space below the lowest region is free again
+  p->cur_max = (mmr = mmrnext(p, 0)) ? mmr->addr : TRAPFRAME;
+  return 0;
+}
+
+// Set the fault-around advice for [addr, addr+length), which must lie
+// in one mapped region; the region is split so the advice covers just
+// that range, then merged with any neighbour that has the same advice
+
+uint64
+sys_madvise(void)
+{
+  uint64 addr;
+  uint64 length;
+  uint64 end;
+  int advice;
+  struct proc *p = myproc();
+  struct mmr *mmr;
+
+  if (argaddr(0, &addr) < 0 || argaddr(1, &length) < 0 || argint(2, &advice) < 0)
+    return -1;
+
+  if (advice != MADV_NORMAL && advice != MADV_RANDOM && advice != MADV_SEQUENTIAL)
+    return -1;
+
+  if (addr % PGSIZE != 0 || length == 0)
+    return -1;
+  end = addr + PGROUNDUP(length);
+
+  if ((mmr = mmrfind(p, addr)) == 0 || end > mmr->addr + mmr->length || end < addr)
+    return -1;
+  if (mmr->advice == advice)
+    return 0;
+
+  if (mmr->addr < addr && (mmr = mmrsplit(p, mmr, addr)) == 0)
+    return -1;
+  if (mmr->addr + mmr->length > end && mmrsplit(p, mmr, end) == 0)
+    return -1;
+  mmr->advice = advice;
+  mmrmerge(p, mmr);
   return 0;
 }
 
@@ -6,7 +6,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
-//#include "pstat.h"
+#include "pstat.h"
+#include "stat.h"
 
 uint64
 sys_exit(void)
@@ -57,21 +58,30 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return sleepuntil(timenow() + (uint64)n * TICKCYCLES);
+}
+
+// sleep for ns nanoseconds, to the resolution of mtime.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return sleepuntil(timenow() + (ns + NSPERCYCLE - 1) / NSPERCYCLE);
+}
+
+// return nanoseconds since boot.
+uint64
+sys_nanotime(void)
+{
+  return timenow() * NSPERCYCLE;
 }
 
 uint64
@@ -84,17 +94,13 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many clock ticks have passed since start.
+// ticks stands still while every CPU is idle, so read
+// the time itself.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return timenow() / TICKCYCLES;
 }
 
 int sys_getprocs(uint64 addr)
@@ -111,6 +117,130 @@ sys_freepmem(void)
   return kfreepagecount();
 }
 
+// copy a snapshot of the page allocator counters to user space.
+uint64
+sys_memstat(void)
+{
+  uint64 addr;
+  struct memstat ms;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  kmemstat(&ms);
+  if(copyout(myproc()->pagetable, addr, (char *)&ms, sizeof(ms)) < 0)
+    return -1;
+  return 0;
+}
+
+// copy a snapshot of the per-CPU idle counters to user space.
+uint64
+sys_cpustat(void)
+{
+  uint64 addr;
+  struct cpustat cs;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  cpustat(&cs);
+  if(copyout(myproc()->pagetable, addr, (char *)&cs, sizeof(cs)) < 0)
+    return -1;
+  return 0;
+}
+
+// copy a snapshot of the buffer cache counters to user space.
+uint64
+sys_bstat(void)
+{
+  uint64 addr;
+  struct bstat bs;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  bstat(&bs);
+  if(copyout(myproc()->pagetable, addr, (char *)&bs, sizeof(bs)) < 0)
+    return -1;
+  return 0;
+}
+
+// copy the MLFQ tunables to user space.
+uint64
+sys_getsched(void)
+{
+  uint64 addr;
+  struct schedparam sp;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  getschedparam(&sp);
+  if(copyout(myproc()->pagetable, addr, (char *)&sp, sizeof(sp)) < 0)
+    return -1;
+  return 0;
+}
+
+// replace the MLFQ tunables with ones from user space.
+uint64
+sys_setsched(void)
+{
+  uint64 addr;
+  struct schedparam sp;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  if(copyin(myproc()->pagetable, (char *)&sp, addr, sizeof(sp)) < 0)
+    return -1;
+  return setschedparam(&sp);
+}
+
+// switch the scheduling policy; returns the old one.
+uint64
+sys_setpolicy(void)
+{
+  int policy;
+
+  if(argint(0, &policy) < 0)
+    return -1;
+  return setpolicy(policy);
+}
+
+// set a process's scheduling class; returns the old one.
+uint64
+sys_setclass(void)
+{
+  int pid, cls;
+
+  if(argint(0, &pid) < 0 || argint(1, &cls) < 0)
+    return -1;
+  return setclass(pid, cls);
+}
+
+// set the caller's STRIDE tickets; returns the old number.
+uint64
+sys_settickets(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return settickets(n);
+}
+
+// futex(addr, FUTEX_WAIT, val) or futex(addr, FUTEX_WAKE, n);
+// see futex.c.
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  if(op == FUTEX_WAIT)
+    return futexwait(addr, val);
+  if(op == FUTEX_WAKE)
+    return futexwake(addr, val);
+  return -1;
+}
+
 //set given semaphore (and value) to the semaphore table
 uint64
 sys_sem_init(void)
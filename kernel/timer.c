@@ -0,0 +1,234 @@
+// Per-CPU timers: high-resolution sleep and tickless idle.
+//
+// Each CPU keeps the processes sleeping until a deadline in
+// a binary min-heap ordered by deadline, in CLINT mtime
+// cycles.  A CPU programs its own mtimecmp with the nearest
+// thing it has to do: the first deadline in its heap, and,
+// only while it is running a process, the next clock tick
+// for time slices and accounting.  An idle CPU with no
+// sleepers programs nothing and takes no timer interrupts
+// at all; a sleeper wakes when its deadline comes rather
+// than at the next tick.
+//
+// Machine mode (timervec in kernelvec.S) only disarms the
+// timer and passes the interrupt on; timerintr() here does
+// the rest.
+//
+// Interface:
+// * sleepuntil(deadline) sleeps the calling process until
+//     mtime reaches deadline; sleep() and nanosleep() use it.
+// * timerintr() handles a timer interrupt on this CPU.
+// * timerarm() reprograms this CPU's timer; the scheduler
+//     calls it when a CPU goes busy or idle.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NEVER (~0ULL)
+
+struct timerq {
+  struct spinlock lock;
+  struct proc **heap;        // heap[0] has the nearest deadline
+  int n;
+  int cap;                   // heap holds cap processes, in 2^order pages
+  int order;
+  volatile uint64 min;       // heap[0]->wakeat, or NEVER; read without the lock
+} timerq[NCPU];
+
+void
+timerqinit(void)
+{
+  for(int i = 0; i < NCPU; i++){
+    initlock(&timerq[i].lock, "timerq");
+    timerq[i].min = NEVER;
+  }
+}
+
+// mtime, in cycles since boot.
+uint64
+timenow(void)
+{
+  return *(volatile uint64 *)CLINT_MTIME;
+}
+
+static void
+heapset(struct timerq *tq, int i, struct proc *p)
+{
+  tq->heap[i] = p;
+  p->timerslot = i;
+}
+
+static void
+heapup(struct timerq *tq, int i)
+{
+  struct proc *p = tq->heap[i];
+
+  while(i > 0 && tq->heap[(i-1)/2]->wakeat > p->wakeat){
+    heapset(tq, i, tq->heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  heapset(tq, i, p);
+}
+
+static void
+heapdown(struct timerq *tq, int i)
+{
+  struct proc *p = tq->heap[i];
+  int c;
+
+  while((c = 2*i + 1) < tq->n){
+    if(c + 1 < tq->n && tq->heap[c+1]->wakeat < tq->heap[c]->wakeat)
+      c++;
+    if(tq->heap[c]->wakeat >= p->wakeat)
+      break;
+    heapset(tq, i, tq->heap[c]);
+    i = c;
+  }
+  heapset(tq, i, p);
+}
+
+// Make room in tq's heap for one more process, doubling the
+// heap if it is full.  tq->lock must be held.  Returns -1 if
+// out of memory.
+static int
+heapgrow(struct timerq *tq)
+{
+  struct proc **heap;
+  int order;
+
+  if(tq->n < tq->cap)
+    return 0;
+  order = tq->heap ? tq->order + 1 : 0;
+  if(order >= NORDER || (heap = kalloc_order(order)) == 0)
+    return -1;
+  if(tq->heap){
+    memmove(heap, tq->heap, tq->n * sizeof(heap[0]));
+    kfree_order(tq->heap, tq->order);
+  }
+  tq->heap = heap;
+  tq->order = order;
+  tq->cap = (PGSIZE << order) / sizeof(heap[0]);
+  return 0;
+}
+
+// Take the process at heap[i] out of tq.
+// tq->lock must be held.
+static void
+heapdel(struct timerq *tq, int i)
+{
+  if(i != --tq->n){
+    heapset(tq, i, tq->heap[tq->n]);
+    heapdown(tq, i);
+    heapup(tq, tq->heap[i]->timerslot);
+  }
+  tq->min = tq->n ? tq->heap[0]->wakeat : NEVER;
+}
+
+// Program this CPU's mtimecmp with its next deadline, if that
+// has changed.  Only this CPU adds to its heap, so tq->min can
+// be read without the lock: another CPU can only raise it, by
+// taking a killed sleeper out, which costs at worst one
+// early interrupt.
+void
+timerarm(void)
+{
+  struct cpu *c;
+  uint64 next, tick;
+  int id;
+
+  push_off();
+  id = cpuid();
+  c = mycpu();
+  next = timerq[id].min;
+  c->ticking = c->proc != 0;
+  if(c->ticking){
+    tick = (timenow() / TICKCYCLES + 1) * TICKCYCLES;
+    if(tick < next)
+      next = tick;
+  }
+  if(next != c->timer){
+    c->timer = next;
+    *(volatile uint64 *)CLINT_MTIMECMP(id) = next;
+  }
+  pop_off();
+}
+
+// The timer went off on this CPU, and timervec has disarmed
+// it: wake the sleepers whose deadlines have passed, advance
+// the tick count, and arm the timer again.  Returns 1 if a
+// clock tick has passed on this CPU since the last call, so
+// that the running process is charged for it.
+int
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  struct timerq *tq = &timerq[cpuid()];
+  struct proc *p;
+  uint64 now = timenow();
+  uint t = now / TICKCYCLES;
+  int tick;
+
+  c->ntimer++;
+  acquire(&tq->lock);
+  while(tq->n > 0 && tq->heap[0]->wakeat <= now){
+    p = tq->heap[0];
+    heapdel(tq, 0);
+    p->wakeat = 0;
+    wakeup(&p->wakeat);
+  }
+  release(&tq->lock);
+
+  tick = t != c->tick;
+  c->tick = t;
+  if(tick)
+    clockintr(t);
+
+  c->timer = NEVER;
+  timerarm();
+  return tick;
+}
+
+// Sleep until mtime reaches deadline.  The deadline goes in
+// the heap of the CPU the caller is on; that CPU's timer
+// wakes it, wherever it runs next.
+// Returns -1 if killed first, or out of memory.
+int
+sleepuntil(uint64 deadline)
+{
+  struct proc *p = myproc();
+  struct timerq *tq;
+  int killed;
+
+  if(deadline <= timenow())
+    return 0;
+
+  push_off();
+  tq = &timerq[cpuid()];
+  acquire(&tq->lock);
+  pop_off();
+  if(heapgrow(tq) < 0){
+    release(&tq->lock);
+    return -1;
+  }
+  p->wakeat = deadline;
+  heapset(tq, tq->n++, p);
+  heapup(tq, p->timerslot);
+  tq->min = tq->heap[0]->wakeat;
+  timerarm();
+
+  while(p->wakeat != 0 && !p->killed)
+    sleep(&p->wakeat, &tq->lock);
+
+  killed = p->wakeat != 0;
+  if(killed){
+    heapdel(tq, p->timerslot);
+    p->wakeat = 0;
+  }
+  release(&tq->lock);
+  return killed ? -1 : 0;
+}
@@ -5,10 +5,10 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "pstat.h"
 
 struct spinlock tickslock;
 uint ticks;
-//struct spinlock listid_lock;
 
 extern char trampoline[], uservec[], userret[];
 
@@ -17,11 +17,17 @@ void kernelvec();
 
 extern int devintr();
 
+// in proc.c.
+extern struct schedparam schedparam;
+extern int sched_policy;
+
+// in start.c; timervec flags pending timer interrupts in it.
+extern uint64 timer_scratch[NCPU][6];
+
 void
 trapinit(void)
 {
   initlock(&tickslock, "time");
-  //initlock(&listid_lock, "listid");
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -68,52 +74,12 @@ usertrap(void)
     intr_on();
     syscall();
 
-  } 
-  // Check if it's 13 or 15
-  else if(r_scause() == 13 || r_scause() == 15){
-
-    uint64 fault_addr = r_stval();
-
-
-    for(int i = 0; i < 10; i++){
-      //if in mapped memory
-      
-      if((fault_addr >= p->mmr[i].addr) && (fault_addr < p->mmr[i].addr + p->mmr[i].length)){
-        
-        // If mapped region allows operation
-        if(r_scause() == 13 && (p->mmr[i].prot && PTE_R)){
-          
-          // Allocates the physical memory frame kalloc()
-          // Maps new frame into the process' page table
-          void *phys_addr = kalloc();
-          memset(phys_addr, 0, PGSIZE);
-          
-          // struct mmr_list *listid_lock = get_mmr_list(p->mmr->mmr_family.listid);
-          // acquire(&listid_lock[p->mmr[i].mmr_family.listid].lock);
-
-          // for (pmmrlist = listid_lock; pmmrlist < &listid_lock[NPROC*MAX_MMR]; pmmrlist++) {
-          //   initlock(&pmmrlist->lock, "mmrlist");
-          //   pmmrlist->valid = 0;
-          // }
-
-          if(mappages(p->pagetable, PGROUNDDOWN(fault_addr),PGSIZE, (uint64)phys_addr, p->mmr[i].prot | PTE_U ) < 0){
-            panic("Unable to allocate physical memory");
-          }
-
-        }
-        else if (r_scause() == 15 && (p->mmr[i].prot && PTE_W)){
-          void *phys_addr = kalloc();
-          memset(phys_addr, 0, PGSIZE);
-          if(mappages(p->pagetable, PGROUNDDOWN(fault_addr), PGSIZE, (uint64)phys_addr, p->mmr[i].prot | PTE_U )< 0){
-            panic("Unable to allocate physical memory");
-          }
-
-        }
-
-      }
-    }
   }
-  
+  else if((r_scause() == 13 || r_scause() == 15) &&
+          vmfault(p->pagetable, r_stval(), r_scause() == 15) != 0){
+    // page fault on a copy-on-write, lazily-allocated
+    // heap, or mapped-region page.
+  }
   else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -127,21 +93,13 @@ usertrap(void)
   
   
   
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2){
-    p->cputime += 1;
-    p->tsticks += 1;
-    if (p->tsticks > timeslice(p->priority)){
-      
-      
-      if (p->priority < LOW){
-        p->priority++;
-        p-> timeslice = timeslice(p->priority);
-      }
-      yield();
-      
-    }
-  }
+  // give up the CPU if this is a timer interrupt
+  // and the process's time slice is over, or if a
+  // process of a higher scheduling class is waiting.
+  if(which_dev == 2 && schedtick(p))
+    yield();
+  else if(which_dev == 1 && preempted(p))
+    yield();
   
   usertrapret();
 }
@@ -214,18 +172,10 @@ kerneltrap()
   }
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING){
-    p->cputime += 1;
-    p->tsticks += 1;
-    if (p->tsticks > timeslice(p->priority)){
-      
-      if(p->tsticks < LOW){
-        p-> priority++;
-        p->timeslice = timeslice(p->priority);
-      }
-      yield();
-    }
-  }
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && schedtick(p))
+    yield();
+  else if(which_dev == 1 && myproc() != 0 && myproc()->state == RUNNING && preempted(p))
+    yield();
   
 
   // the yield() may have caused some traps to occur,
@@ -234,19 +184,31 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// a CPU's timer saw clock tick t, mtime / TICKCYCLES.  every
+// busy CPU ticks, and idle ones don't, so ticks follows the
+// first CPU to see each tick.
 void
-clockintr()
+clockintr(uint t)
 {
+  uint old;
+
+  if(t <= ticks)
+    return;
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  old = ticks;
+  if(t > old)
+    ticks = t;
   release(&tickslock);
+
+  if(t > old && sched_policy == MLFQ && schedparam.boost > 0 &&
+     t / schedparam.boost != old / schedparam.boost)
+    priboost();
 }
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
-// 1 if other device,
+// 1 if other device or an IPI,
 // 0 if not recognized.
 int
 devintr()
@@ -276,18 +238,20 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // an IPI only had to end the hart's wfi.
+    if(__atomic_exchange_n(&timer_scratch[cpuid()][5], 0, __ATOMIC_SEQ_CST) == 0)
+      return 1;
+
+    // the timer: a clock tick, or just a sleeper's deadline.
+    kstackflush();
+    return timerintr() ? 2 : 1;
   } else {
     return 0;
   }
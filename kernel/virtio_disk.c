@@ -17,6 +17,10 @@
 #include "buf.h"
 #include "virtio.h"
 
+// most buffers moved by one request.  the chain is MAXSEG+2
+// descriptors long, and qemu's limit (seg_max) is far above.
+#define MAXSEG 8
+
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 
@@ -59,12 +63,17 @@ static struct disk {
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
-  // indexed by first descriptor index of chain.
+  // b is the buffer of a data descriptor, indexed by that
+  // descriptor; status is indexed by the first descriptor
+  // index of the chain.
   struct {
     struct buf *b;
     char status;
   } info[NUM];
 
+  uint64 nreq;     // requests handed to the device
+  uint64 nblock;   // blocks those requests moved
+
   // disk command headers.
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
@@ -184,12 +193,11 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
+  for(int i = 0; i < n; i++){
     idx[i] = alloc_desc();
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
@@ -200,27 +208,15 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// format the n+2 descriptors in idx for one transfer of the n
+// buffers in bs, which hold consecutive blocks, and hand them
+// to the device.  disk.vdisk_lock must be held.
+static void
+virtio_disk_start(struct buf **bs, int n, int write, int *idx)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
-
-  acquire(&disk.vdisk_lock);
+  uint64 sector = bs[0]->blockno * (BSIZE / 512);
 
-  // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
-
-  // allocate the three descriptors.
-  int idx[3];
-  while(1){
-    if(alloc3_desc(idx) == 0) {
-      break;
-    }
-    sleep(&disk.free[0], &disk.vdisk_lock);
-  }
-
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
   struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
@@ -237,24 +233,29 @@ virtio_disk_rw(struct buf *b, int write)
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  // one data descriptor per buffer; the device moves them
+  // to and from consecutive sectors.
+  for(int i = 1; i <= n; i++){
+    struct buf *b = bs[i-1];
+    disk.desc[idx[i]].addr = (uint64) b->data;
+    disk.desc[idx[i]].len = BSIZE;
+    if(write)
+      disk.desc[idx[i]].flags = 0; // device reads b->data
+    else
+      disk.desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes b->data
+    disk.desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    disk.desc[idx[i]].next = idx[i+1];
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+    // record struct buf for virtio_disk_intr().
+    b->disk = 1;
+    disk.info[idx[i]].b = b;
+  }
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  disk.info[idx[0]].status = 0xff; // device writes 0 on success
+  disk.desc[idx[n+1]].addr = (uint64) &disk.info[idx[0]].status;
+  disk.desc[idx[n+1]].len = 1;
+  disk.desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  disk.desc[idx[n+1]].next = 0;
 
   // tell the device the first index in our chain of descriptors.
   disk.avail->ring[disk.avail->idx % NUM] = idx[0];
@@ -268,14 +269,91 @@ virtio_disk_rw(struct buf *b, int write)
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  disk.nreq++;
+  disk.nblock += n;
+}
+
+// Start transfers of the n locked buffers in bs, sleeping until
+// there are descriptors for them, and return without waiting
+// for them to finish.  The buffers must hold consecutive blocks,
+// in order; they go to the device MAXSEG at a time, each group
+// as one request with a data descriptor per buffer.  Any number
+// of buffers may be in flight at once.  When a buffer is done
+// virtio_disk_intr() clears b->disk and calls b->iodone(b), if
+// set, or else wakes virtio_disk_wait(b).
+void
+virtio_disk_submit(struct buf **bs, int n, int write)
+{
+  int idx[MAXSEG+2], k;
+
+  for(int i = 1; i < n; i++)
+    if(bs[i]->blockno != bs[0]->blockno + i)
+      panic("virtio_disk_submit");
+
+  acquire(&disk.vdisk_lock);
+
+  // the spec's Section 5.2 says that legacy block operations use
+  // a descriptor for type/reserved/sector, then the data, then
+  // a descriptor for a 1-byte status result.
+  for(; n > 0; bs += k, n -= k){
+    k = n < MAXSEG ? n : MAXSEG;
+    while(alloc_descs(idx, k+2) < 0)
+      sleep(&disk.free[0], &disk.vdisk_lock);
+    virtio_disk_start(bs, k, write, idx);
+  }
+
+  release(&disk.vdisk_lock);
+}
+
+// Like virtio_disk_submit(), but rather than wait for
+// descriptors, stop: read-ahead should not hold up the
+// transfers that are wanted now.  Returns how many of the
+// buffers, from the first, it started.
+int
+virtio_disk_trysubmit(struct buf **bs, int n, int write)
+{
+  int idx[MAXSEG+2], k, started = 0;
+
+  for(int i = 1; i < n; i++)
+    if(bs[i]->blockno != bs[0]->blockno + i)
+      panic("virtio_disk_trysubmit");
+
+  acquire(&disk.vdisk_lock);
+  for(; n > 0; bs += k, n -= k, started += k){
+    k = n < MAXSEG ? n : MAXSEG;
+    if(alloc_descs(idx, k+2) < 0)
+      break;
+    virtio_disk_start(bs, k, write, idx);
   }
+  release(&disk.vdisk_lock);
+  return started;
+}
+
+// Wait for the transfer of b started by virtio_disk_submit().
+void
+virtio_disk_wait(struct buf *b)
+{
+  acquire(&disk.vdisk_lock);
+  while(b->disk == 1)
+    sleep(b, &disk.vdisk_lock);
+  release(&disk.vdisk_lock);
+}
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+void
+virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_submit(&b, 1, write);
+  virtio_disk_wait(b);
+}
 
+// Report how many requests the disk has been given since
+// boot, and how many blocks they moved.
+void
+virtio_disk_stat(uint64 *nreq, uint64 *nblock)
+{
+  acquire(&disk.vdisk_lock);
+  *nreq = disk.nreq;
+  *nblock = disk.nblock;
   release(&disk.vdisk_lock);
 }
 
@@ -304,9 +382,24 @@ virtio_disk_intr()
     if(disk.info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    // finish each buffer in the chain, then free it.
+    for(int i = id; ; i = disk.desc[i].next){
+      struct buf *b = disk.info[i].b;
+      if(b){
+        disk.info[i].b = 0;
+        b->disk = 0;   // disk is done with buf
+        if(b->iodone){
+          void (*iodone)(struct buf*) = b->iodone;
+          b->iodone = 0;
+          iodone(b);
+        } else {
+          wakeup(b);
+        }
+      }
+      if((disk.desc[i].flags & VRING_DESC_F_NEXT) == 0)
+        break;
+    }
+    free_chain(id);
 
     disk.used_idx += 1;
   }
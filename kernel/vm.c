@@ -3,8 +3,13 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
 
 /*
  * the kernel's page table.
@@ -15,14 +20,16 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+static int mapmegapages(pagetable_t, uint64, uint64, uint64, int);
+pte_t *walk(pagetable_t, uint64, int);
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kzalloc();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -30,22 +37,39 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, for sending IPIs and reading mtime
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
-  // map kernel data and the physical RAM we'll make use of.
-  kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
+  // map kernel data and the physical RAM we'll make use of,
+  // with 2 MiB megapages from the first megapage boundary on.
+  uint64 mega = MEGAROUNDUP((uint64)etext);
+  if(mega > PHYSTOP)
+    mega = PHYSTOP;
+  if(mega > (uint64)etext)
+    kvmmap(kpgtbl, (uint64)etext, (uint64)etext, mega-(uint64)etext, PTE_R | PTE_W);
+  if(MEGAROUNDDOWN(PHYSTOP) > mega &&
+     mapmegapages(kpgtbl, mega, MEGAROUNDDOWN(PHYSTOP)-mega, mega, PTE_R | PTE_W) != 0)
+    panic("kvmmake");
+  if(PHYSTOP > MEGAROUNDDOWN(PHYSTOP) && MEGAROUNDDOWN(PHYSTOP) >= mega)
+    kvmmap(kpgtbl, MEGAROUNDDOWN(PHYSTOP), MEGAROUNDDOWN(PHYSTOP),
+           PHYSTOP-MEGAROUNDDOWN(PHYSTOP), PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // map kernel stacks
-  proc_mapstacks(kpgtbl);
-  
+  // page-table pages for the kernel stacks, so that
+  // kvmmapstack() never has to allocate one.
+  for(uint64 a = MEGAROUNDDOWN(KSTACK(NPROC-1)); a <= KSTACK(0); a += MEGAPGSIZE)
+    if(walk(kpgtbl, a, 1) == 0)
+      panic("kvmmake: kstack");
+
   return kpgtbl;
 }
 
@@ -65,9 +89,32 @@ kvminithart()
   sfence_vma();
 }
 
+// Replace the megapage leaf *pte with a page-table page of
+// 512 4 KiB PTEs that map the same memory with the same
+// permissions.  Each page of a megapage already has its own
+// reference count, so from then on the pages can be shared
+// and freed one at a time.
+// Returns 0 on success, -1 if out of memory.
+static int
+splitmega(pte_t *pte)
+{
+  pagetable_t pt;
+  uint64 pa = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte);
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+  return 0;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page-table pages.
+// create any required page-table pages.  A megapage that
+// covers va is split into 4 KiB pages first; returns 0 if
+// there's no memory for that.
 //
 // The risc-v Sv39 scheme has three levels of page-table
 // pages. A page-table page contains 512 64-bit PTEs.
@@ -85,18 +132,75 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
 
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
+    if((*pte & PTE_V) && PTE_LEAF(*pte)) {
+      if(level != 1)
+        panic("walk: gigapage");
+      if(splitmega(pte) < 0)
+        return 0;
+    }
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kzalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
   return &pagetable[PX(0, va)];
 }
 
+// Like walk(), but never allocates and leaves megapages
+// alone.  Returns the valid leaf PTE that maps va, setting
+// *mega if it is a level-1 megapage PTE, or 0 if va isn't
+// mapped.
+static pte_t *
+walkleaf(pagetable_t pagetable, uint64 va, int *mega)
+{
+  pte_t *pte;
+
+  *mega = 0;
+  if(va >= MAXVA)
+    return 0;
+  for(int level = 2; level > 0; level--) {
+    pte = &pagetable[PX(level, va)];
+    if((*pte & PTE_V) == 0)
+      return 0;
+    if(PTE_LEAF(*pte)) {
+      if(level != 1)
+        panic("walkleaf: gigapage");
+      *mega = 1;
+      return pte;
+    }
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  }
+  pte = &pagetable[PX(0, va)];
+  if((*pte & PTE_V) == 0)
+    return 0;
+  return pte;
+}
+
+// Return the address of the level-1 PTE for va, which maps
+// the 2 MiB-aligned stretch around it.  If alloc!=0, create
+// the level-1 page-table page if needed.
+static pte_t *
+walkmega(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pte;
+
+  if(va >= MAXVA)
+    panic("walkmega");
+
+  pte = &pagetable[PX(2, va)];
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if(!alloc || (pagetable = (pde_t*)kzalloc()) == 0)
+      return 0;
+    *pte = PA2PTE(pagetable) | PTE_V;
+  }
+  return &pagetable[PX(1, va)];
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -105,18 +209,19 @@ walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int mega;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walkleaf(pagetable, va, &mega);
   if(pte == 0)
     return 0;
-  if((*pte & PTE_V) == 0)
-    return 0;
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(mega)
+    pa += PGROUNDDOWN(va) - MEGAROUNDDOWN(va);
   return pa;
 }
 
@@ -130,6 +235,38 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
+// Map the page pa at va, a KSTACK() slot with no page, in
+// the kernel page table.  Its page-table pages are there from
+// boot, so this only sets the leaf PTE.  A slot is reused only
+// after every hart has flushed its TLB since it was unmapped
+// (see kstackfree() in proc.c), so only this hart's is flushed.
+void
+kvmmapstack(uint64 va, uint64 pa)
+{
+  pte_t *pte;
+
+  if((pte = walk(kernel_pagetable, va, 0)) == 0 || (*pte & PTE_V))
+    panic("kvmmapstack");
+  *pte = PA2PTE(pa) | PTE_R | PTE_W | PTE_V;
+  sfence_vma();
+}
+
+// Unmap the KSTACK() slot at va from the kernel page table,
+// flushing only this hart's TLB, and return its page.
+uint64
+kvmunmapstack(uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+
+  if((pte = walk(kernel_pagetable, va, 0)) == 0 || (*pte & PTE_V) == 0)
+    panic("kvmunmapstack");
+  pa = PTE2PA(*pte);
+  *pte = 0;
+  sfence_vma();
+  return pa;
+}
+
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
@@ -159,23 +296,58 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Create level-1 leaf PTEs that map size bytes at va to
+// physical addresses starting at pa with 2 MiB megapages.
+// va, pa and size must be megapage-aligned.
+// Returns 0 on success, -1 if walkmega() couldn't allocate
+// a needed page-table page.
+static int
+mapmegapages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a;
+  pte_t *pte;
+
+  if(size == 0 || (va % MEGAPGSIZE) || (size % MEGAPGSIZE) || (pa % MEGAPGSIZE))
+    panic("mapmegapages");
+
+  for(a = va; a < va + size; a += MEGAPGSIZE, pa += MEGAPGSIZE){
+    if((pte = walkmega(pagetable, a, 1)) == 0)
+      return -1;
+    if(*pte & PTE_V)
+      panic("mapmegapages: remap");
+    *pte = PA2PTE(pa) | perm | PTE_V;
+  }
+  return 0;
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. Pages that were never faulted in (see
+// vmfault()) have no mapping and are skipped. A megapage
+// must lie wholly inside or outside the range: callers split
+// one that straddles an end beforehand (see uvmsplit()), so
+// that this can't fail. Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
   uint64 a;
   pte_t *pte;
+  int mega;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+    if((pte = walkleaf(pagetable, a, &mega)) == 0)
+      continue;
+    if(mega && a == MEGAROUNDDOWN(a) && a + MEGAPGSIZE <= va + npages*PGSIZE){
+      if(do_free)
+        kfree_order((void*)PTE2PA(*pte), MEGAORDER);
+      *pte = 0;
+      a += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    if(mega)
+      panic("uvmunmap: partial megapage");
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -186,16 +358,30 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   }
 }
 
+// Split the megapage that maps va into 4 KiB pages, if there
+// is one and va lies inside it rather than at its start, so
+// that the mappings on either side of va can change apart.
+// Returns 0, or -1 if out of memory.
+int
+uvmsplit(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  int mega;
+
+  if(va % MEGAPGSIZE == 0 || (pte = walkleaf(pagetable, va, &mega)) == 0 || !mega)
+    return 0;
+  return splitmega(pte);
+}
+
 // create an empty user page table.
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kzalloc();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -209,8 +395,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -228,12 +413,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -291,45 +475,307 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory from start to end with a child's page table.
+// Writable pages become read-only and copy-on-write in
+// both page tables; the first store to one takes a page
+// fault and cowcopy() gives the writer its own copy.
+// Pages the parent never touched stay unmapped in both.
+// Megapages are split, since pages are copied one by one.
 // returns 0 on success, -1 on failure.
-// frees any allocated pages on failure.
+// unmaps any pages shared with the child on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
 {
     pte_t *pte;
     uint64 pa, i;
     uint flags;
-    char *mem;
+    int mega;
 
     for(i = start; i < end; i += PGSIZE){
-        if((pte = walk(old, i, 0)) == 0)
-            panic("uvmcopy: pte should exist");
-        if((*pte & PTE_V) == 0)
-            panic("uvmcopy: page not present");
+        if((pte = walkleaf(old, i, &mega)) == 0)
+            continue;
+        if(mega && (pte = walk(old, i, 0)) == 0)
+            goto err;
 
         pa = PTE2PA(*pte);
         flags = PTE_FLAGS(*pte);
+        if(flags & PTE_W){
+            flags = (flags & ~PTE_W) | PTE_COW;
+            *pte = PA2PTE(pa) | flags;
+        }
 
-        if((mem = kalloc()) == 0)
-            goto err;
-
-        memmove(mem, (char*)pa, PGSIZE);
-
-        if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-            kfree(mem);
+        if(mappages(new, i, PGSIZE, pa, flags) != 0)
             goto err;
-        }
-    }   
+        kdup((void*)pa);
+    }
+    // the parent's PTEs lost PTE_W.
+    sfence_vma();
     return 0;
 
     err:
-    uvmunmap(new, 0, i / PGSIZE, 1);
+    sfence_vma();
+    uvmunmap(new, start, (i - start) / PGSIZE, 1);
     return -1;
 }
+
+// Return 1 if va is mapped to a copy-on-write user page.
+int
+cowpage(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  int mega;
+
+  pte = walkleaf(pagetable, va, &mega);
+  if(pte == 0 || mega)
+    return 0;
+  return (*pte & (PTE_V|PTE_U|PTE_COW)) == (PTE_V|PTE_U|PTE_COW);
+}
+
+// Give the copy-on-write page at va a private, writable copy.
+// If no one else holds a reference any more, just makes the
+// existing page writable.
+// Returns 0 on success, -1 if out of memory.
+int
+cowcopy(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(!cowpage(pagetable, va))
+    panic("cowcopy");
+  pte = walk(pagetable, va, 0);
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  if(krefcnt((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+  }
+  sfence_vma();
+  return 0;
+}
+
+// If no 4 KiB page is mapped in the megapage-aligned stretch
+// at va, return the level-1 PTE a megapage for it would go
+// in, freeing any empty level-0 page-table page left there.
+// Otherwise return 0.
+static pte_t *
+megaslot(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  pagetable_t pt;
+
+  if((pte = walkmega(pagetable, va, 1)) == 0)
+    return 0;
+  if((*pte & PTE_V) == 0)
+    return pte;
+  if(PTE_LEAF(*pte))
+    return 0;
+  pt = (pagetable_t)PTE2PA(*pte);
+  for(int i = 0; i < 512; i++)
+    if(pt[i] & PTE_V)
+      return 0;
+  kfree((void*)pt);
+  *pte = 0;
+  return pte;
+}
+
+// Return the page to map at va in region mmr, with a
+// reference for the new mapping: the file's cached page for
+// a file mapping, or else a fresh zeroed page.  A private
+// file page is shared with the page cache, so *perm loses
+// PTE_W in favour of PTE_COW.  Returns 0 if out of memory.
+static char *
+mmrpage(struct mmr *mmr, uint64 va, int *perm)
+{
+  if(mmr->file == 0)
+    return kzalloc();
+  if((mmr->flags & MAP_PRIVATE) && (*perm & PTE_W))
+    *perm = (*perm & ~PTE_W) | PTE_COW;
+  return pcget(mmr->file->ip, mmr->offset + (va - mmr->addr));
+}
+
+// Map pages next to va, a page of region mmr that
+// just faulted, so that touching them later doesn't trap
+// (for a file, this reads ahead through the page cache):
+// the aligned FAULTAROUND-page window that holds va, or the
+// FAULTAHEAD pages from va on for MADV_SEQUENTIAL, or none
+// for MADV_RANDOM.  The window stays inside the region and
+// inside va's 2 MiB stretch, so that it doesn't take away a
+// neighbouring stretch's chance of a megapage.  Pages that
+// are already mapped are skipped, and running out of memory
+// just ends the window early.
+static void
+faultaround(pagetable_t pagetable, struct mmr *mmr, uint64 va, int perm)
+{
+  uint64 a, start, end;
+  char *mem;
+  int mega, p;
+
+  switch(mmr->advice){
+  case MADV_RANDOM:
+    return;
+  case MADV_SEQUENTIAL:
+    start = va;
+    end = va + FAULTAHEAD*PGSIZE;
+    break;
+  default:
+    start = va & ~(FAULTAROUND*PGSIZE - 1);
+    end = start + FAULTAROUND*PGSIZE;
+    break;
+  }
+  if(start < mmr->addr)
+    start = mmr->addr;
+  if(end > mmr->addr + mmr->length)
+    end = mmr->addr + mmr->length;
+  if(end > MEGAROUNDDOWN(va) + MEGAPGSIZE)
+    end = MEGAROUNDDOWN(va) + MEGAPGSIZE;
+
+  for(a = start; a < end; a += PGSIZE){
+    if(walkleaf(pagetable, a, &mega) != 0)
+      continue;
+    p = perm;
+    if((mem = mmrpage(mmr, a, &p)) == 0)
+      break;
+    if(mappages(pagetable, a, PGSIZE, (uint64)mem, p) != 0){
+      kfree(mem);
+      break;
+    }
+  }
+}
+
+// Handle a page fault at va in the current process, whose
+// page table is pagetable.  A store to a copy-on-write page
+// gets a private copy; a touch of an unmapped page in the
+// heap (sbrk() only moves p->sz) or in a mapped region gets
+// a fresh zeroed page.  An untouched, aligned 2 MiB stretch
+// of a mapped region gets a whole megapage if one is free,
+// and other faults in a region map a window of pages around
+// va (see faultaround()).  write is 1 for a store.
+// Returns the physical address of the page, or 0 if va
+// isn't valid for the access, memory is exhausted, or a file
+// page is needed while the caller holds a spinlock.
+uint64
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  struct mmr *mmr = 0;
+  pte_t *pte;
+  char *mem;
+  uint64 base;
+  int perm, faultperm, mega, locked;
+
+  if(p == 0 || pagetable != p->pagetable || va >= MAXVA)
+    return 0;
+  va = PGROUNDDOWN(va);
+
+  pte = walkleaf(pagetable, va, &mega);
+  if(pte){
+    if(!write || !cowpage(pagetable, va))
+      return 0;
+    if(cowcopy(pagetable, va) < 0)
+      return 0;
+    return PTE2PA(*pte);
+  }
+
+  if(va < p->sz){
+    perm = PTE_W|PTE_X|PTE_R|PTE_U;
+  } else {
+    mmr = mmrfind(p, va);
+    if(mmr == 0 || (mmr->prot & (write ? PTE_W : PTE_R)) == 0)
+      return 0;
+    if(mmr->file){
+      // pcget() may read the page in, which sleeps: refuse
+      // if the caller holds a spinlock.
+      push_off();
+      locked = mycpu()->noff > 1;
+      pop_off();
+      if(locked)
+        return 0;
+    }
+    perm = (mmr->prot & (PTE_R|PTE_W|PTE_X)) | PTE_U;
+
+    base = MEGAROUNDDOWN(va);
+    if(mmr->file == 0 && base >= mmr->addr && base + MEGAPGSIZE <= mmr->addr + mmr->length &&
+       (pte = megaslot(pagetable, base)) != 0 &&
+       (mem = kalloc_order(MEGAORDER)) != 0){
+      memset(mem, 0, MEGAPGSIZE);
+      *pte = PA2PTE(mem) | perm | PTE_V;
+      return (uint64)mem + (va - base);
+    }
+  }
+
+  faultperm = perm;
+  mem = mmr ? mmrpage(mmr, va, &faultperm) : kzalloc();
+  if(mem == 0)
+    return 0;
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, faultperm) != 0){
+    kfree(mem);
+    return 0;
+  }
+  if(mmr)
+    faultaround(pagetable, mmr, va, perm);
+  if(write && (faultperm & PTE_COW)){
+    // a store to a private file page: copy it right away.
+    if(cowcopy(pagetable, va) < 0)
+      return 0;
+    return walkaddr(pagetable, va);
+  }
+  return (uint64)mem;
+}
+
+// Fault in the pages of [va, va+len) that lie in mapped files
+// and aren't mapped yet.  read() and write() call this before
+// they lock anything, because faulting in a file page locks
+// that file's inode in pcget(): taken with another inode
+// locked, two processes could deadlock; taken with the same
+// one locked, readi() or writei() holds a buffer the page
+// read may need; and under a spinlock, as piperead() and
+// pipewrite() copy, vmfault() refuses.  Failures are left for
+// the copy to find.  write is 1 if the pages will be stored to.
+void
+uvmprefault(pagetable_t pagetable, uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  struct mmr *m;
+  uint64 a, end = va + len;
+
+  if(end < va || end > MAXVA)
+    end = MAXVA;
+  for(m = mmrnext(p, va); m && m->addr < end; m = mmrnext(p, m->addr + m->length)){
+    if(m->file == 0)
+      continue;
+    a = PGROUNDDOWN(va > m->addr ? va : m->addr);
+    for(; a < end && a < m->addr + m->length; a += PGSIZE)
+      if(walkaddr(pagetable, a) == 0)
+        vmfault(pagetable, a, write);
+  }
+}
+
+// Return the physical address of the page mapped at va if
+// the hardware has marked it dirty, else 0.
+uint64
+uvmdirty(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  int mega;
+
+  pte = walkleaf(pagetable, va, &mega);
+  if(pte == 0 || (*pte & PTE_D) == 0)
+    return 0;
+  if(mega)
+    return PTE2PA(*pte) + (PGROUNDDOWN(va) - MEGAROUNDDOWN(va));
+  return PTE2PA(*pte);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -390,6 +836,8 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0 || cowpage(pagetable, va0))
+      pa0 = vmfault(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -406,6 +854,8 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
 // Copies the parent process’s page table to the child
 // Duplicates the page table mappings so that the physical memory is shared
+// Pages the parent never touched are skipped; megapages stay megapages
+// Each page gets a reference for the child, so it is freed with its last mapping
 // Returns 0 on success, -1 on failure
 int
 uvmcopyshared(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
@@ -414,26 +864,36 @@ uvmcopyshared(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
   pte_t *pte;
   uint64 pa, i;
   uint flags;
+  int mega;
 
   for(i = start; i < end; i += PGSIZE){
 
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walkleaf(old, i, &mega)) == 0)
+      continue;
 
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
 
+    if(mega && i == MEGAROUNDDOWN(i) && i + MEGAPGSIZE <= end){
+      if(mapmegapages(new, i, MEGAPGSIZE, pa, flags) != 0)
+        goto err;
+      for(int j = 0; j < MEGAPGSIZE; j += PGSIZE)
+        kdup((void*)(pa + j));
+      i += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    if(mega)
+      pa += i - MEGAROUNDDOWN(i);
+
     if(mappages(new, i, PGSIZE, (uint64)pa, flags) != 0){
       goto err;
     }
+    kdup((void*)pa);
   }
   return 0;
 
   err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
@@ -448,6 +908,8 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0)
+      pa0 = vmfault(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -475,6 +937,8 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    if(pa0 == 0)
+      pa0 = vmfault(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -504,32 +968,3 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
     return -1;
   }
 }
-
-// Allocate page table pages for PTEs if needed but leave valid bits unchanged
-int
-mapvpages(pagetable_t pagetable, uint64 va, uint64 size)
-{
-
-uint64 a, last;
-pte_t *pte;
-
-if(size == 0)
-  panic("mappages: size");
-a = PGROUNDDOWN(va);
-last = PGROUNDDOWN(va + size - 1);
-
-for(;;){
-  if((pte = walk(pagetable, a, 1)) == 0)
-    return -1;
-
-  if(*pte & PTE_V)
-    panic("mappages: remap");
-  if(a == last)
-    break;
-    //check this
-  a += PGSIZE;
-}
-
-return 0;
-
-}
@@ -0,0 +1,85 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+// bcachebench [maxprocs [rounds]]
+// have 1, 2, 4, ... maxprocs processes (default 8) each read
+// its own one-block file from the start, rounds times, and
+// print the reads per second they made together.  the files
+// stay in the buffer cache, so every read is a cache hit on
+// a different block, and reads that keep up as processes are
+// added mean hits on different blocks don't wait for each
+// other.
+
+static char path[] = "bcbench0";
+
+static void
+reader(int i, int rounds)
+{
+  char buf[BSIZE];
+  int fd;
+
+  path[7] = '0' + i;
+  for(int r = 0; r < rounds; r++){
+    if((fd = open(path, O_RDONLY)) < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "bcachebench: read %s failed\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxprocs = 8, rounds = 2000;
+  char buf[BSIZE];
+  int fd, pid;
+  uint64 t0, dt;
+
+  if(argc >= 2)
+    maxprocs = atoi(argv[1]);
+  if(argc >= 3)
+    rounds = atoi(argv[2]);
+  if(maxprocs < 1 || maxprocs > 10 || rounds < 1){
+    fprintf(2, "usage: bcachebench [maxprocs [rounds]]\n");
+    exit(1);
+  }
+
+  memset(buf, 'b', sizeof(buf));
+  for(int i = 0; i < maxprocs; i++){
+    path[7] = '0' + i;
+    if((fd = open(path, O_CREATE | O_TRUNC | O_WRONLY)) < 0 ||
+       write(fd, buf, sizeof(buf)) != sizeof(buf)){
+      fprintf(2, "bcachebench: create %s failed\n", path);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  for(int n = 1; n <= maxprocs; n *= 2){
+    t0 = nanotime();
+    for(int i = 0; i < n; i++){
+      pid = fork();
+      if(pid < 0){
+        fprintf(2, "bcachebench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        reader(i, rounds);
+    }
+    for(int i = 0; i < n; i++)
+      wait(0);
+    dt = nanotime() - t0;
+    printf("%d procs: %l reads/s\n", n, (uint64)n * rounds * 1000000 / (dt / 1000 + 1));
+  }
+
+  for(int i = 0; i < maxprocs; i++){
+    path[7] = '0' + i;
+    unlink(path);
+  }
+  exit(0);
+}
@@ -0,0 +1,53 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/pstat.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+// bstat [interval]
+// print the size of the buffer cache and how it has done
+// since boot: hits, misses, buffers recycled for other
+// blocks, blocks read ahead, pages taken from and given
+// back to the page allocator, and disk requests and the
+// blocks they moved; with an interval (in ticks), keep
+// polling and print the size and the hit rate over each
+// interval.
+
+static uint64
+pct(uint64 part, uint64 whole)
+{
+  return whole ? part * 100 / whole : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct bstat bs, prev;
+  int interval = 0;
+
+  if(argc == 2)
+    interval = atoi(argv[1]);
+
+  if(bstat(&bs) < 0){
+    fprintf(2, "bstat: failed\n");
+    exit(1);
+  }
+  printf("buffers %l (%l KiB), %l holding no block\n", bs.nbuf, bs.nbuf * BSIZE / 1024, bs.nfree);
+  printf("hits %l misses %l (%l%% hit) evictions %l read ahead %l\n", bs.nhit, bs.nmiss,
+         pct(bs.nhit, bs.nhit + bs.nmiss), bs.nevict, bs.nahead);
+  printf("pages grown %l shrunk %l\n", bs.ngrow, bs.nshrink);
+  printf("disk requests %l blocks %l\n", bs.ndiskreq, bs.ndiskblock);
+
+  while(interval > 0){
+    prev = bs;
+    sleep(interval);
+    if(bstat(&bs) < 0){
+      fprintf(2, "bstat: failed\n");
+      exit(1);
+    }
+    uint64 hits = bs.nhit - prev.nhit, misses = bs.nmiss - prev.nmiss;
+    printf("buffers %l hits %l misses %l (%l%% hit) evictions %l read ahead %l\n", bs.nbuf,
+           hits, misses, pct(hits, hits + misses), bs.nevict - prev.nevict, bs.nahead - prev.nahead);
+  }
+  exit(0);
+}
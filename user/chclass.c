@@ -0,0 +1,38 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// chclass rt|normal|batch command [args...]
+// run command in the given scheduling class: rt runs ahead
+// of everything else and is never time-sliced, batch only
+// when nothing else wants the CPU.  Forked children keep
+// the class.
+
+int
+main(int argc, char *argv[])
+{
+  int cls;
+
+  if(argc < 3){
+    fprintf(2, "usage: chclass rt|normal|batch command [args...]\n");
+    exit(1);
+  }
+  if(strcmp(argv[1], "rt") == 0)
+    cls = SCHED_RT;
+  else if(strcmp(argv[1], "normal") == 0)
+    cls = SCHED_NORMAL;
+  else if(strcmp(argv[1], "batch") == 0)
+    cls = SCHED_BATCH;
+  else {
+    fprintf(2, "chclass: unknown class %s\n", argv[1]);
+    exit(1);
+  }
+
+  if(setclass(0, cls) < 0){
+    fprintf(2, "chclass: setclass failed\n");
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "chclass: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,51 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/pstat.h"
+#include "user/user.h"
+
+// cpustat [interval]
+// print how long each CPU has sat parked in wfi since
+// boot, how often it parked, how many wakeup IPIs it was
+// sent and how many timer interrupts it took; with an
+// interval (in ticks), keep polling and print each CPU's
+// idle percentage and timer interrupts over each interval.
+
+int
+main(int argc, char *argv[])
+{
+  struct cpustat cs, prev;
+  int interval = 0;
+
+  if(argc == 2)
+    interval = atoi(argv[1]);
+
+  if(cpustat(&cs) < 0){
+    fprintf(2, "cpustat: failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < NCPU; i++){
+    if(!cs.online[i])
+      continue;
+    printf("cpu %d: idle %l%% parked %l ipis %l timers %l\n", i,
+           cs.time ? cs.idle[i] * 100 / cs.time : 0, cs.nidle[i], cs.nipi[i], cs.ntimer[i]);
+  }
+
+  while(interval > 0){
+    prev = cs;
+    sleep(interval);
+    if(cpustat(&cs) < 0){
+      fprintf(2, "cpustat: failed\n");
+      exit(1);
+    }
+    uint64 dt = cs.time - prev.time;
+    if(dt == 0)
+      dt = 1;
+    for(int i = 0; i < NCPU; i++){
+      if(!cs.online[i])
+        continue;
+      printf("cpu %d: idle %l%% timers %l%s", i, (cs.idle[i] - prev.idle[i]) * 100 / dt,
+             cs.ntimer[i] - prev.ntimer[i], i + 1 < NCPU && cs.online[i+1] ? "  " : "\n");
+    }
+  }
+  exit(0);
+}
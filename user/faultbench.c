@@ -0,0 +1,52 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// faultbench [kilobytes [rounds]]
+// time touching every page of a fresh mmap() region once,
+// for each madvise() hint: MADV_RANDOM maps one page per
+// fault, MADV_NORMAL a window around the fault, and
+// MADV_SEQUENTIAL a run of pages ahead of it.  keep the
+// region under 2 MiB so that it isn't backed by megapages.
+
+char *names[] = { "random", "normal", "sequential" };
+int advice[] = { MADV_RANDOM, MADV_NORMAL, MADV_SEQUENTIAL };
+
+int
+main(int argc, char *argv[])
+{
+  int kb = 1024, rounds = 50, size, t0;
+  volatile char *a;
+
+  if(argc >= 2)
+    kb = atoi(argv[1]);
+  if(argc >= 3)
+    rounds = atoi(argv[2]);
+  if(kb <= 0 || rounds <= 0){
+    fprintf(2, "usage: faultbench [kilobytes [rounds]]\n");
+    exit(1);
+  }
+  size = kb * 1024;
+
+  printf("%d KB x %d rounds\n", kb, rounds);
+  for(int i = 0; i < sizeof(advice)/sizeof(advice[0]); i++){
+    t0 = uptime();
+    for(int r = 0; r < rounds; r++){
+      a = mmap(0, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+      if(a == (char*)0xffffffffffffffffL){
+        fprintf(2, "faultbench: mmap failed\n");
+        exit(1);
+      }
+      if(madvise((char*)a, size, advice[i]) < 0){
+        fprintf(2, "faultbench: madvise failed\n");
+        exit(1);
+      }
+      for(int off = 0; off < size; off += PGSIZE)
+        a[off] = 1;
+      munmap((char*)a, size);
+    }
+    printf("%s: %d ticks\n", names[i], uptime() - t0);
+  }
+  exit(0);
+}
@@ -7,12 +7,43 @@
 char buf[1024];
 int match(char*, char*);
 
+// match the lines of a regular file in place through a
+// private mapping of it, rather than read() it into buf.
+// the extra byte past the end of the file reads as zero,
+// ending the last line's string.
+// returns 0 if the file can't be mapped.
+int
+grepmap(char *pattern, int fd)
+{
+  struct stat st;
+  char *buf, *p, *q;
+
+  if(fstat(fd, &st) < 0 || st.type != T_FILE || st.size == 0)
+    return 0;
+  buf = mmap(0, st.size + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(buf == (char*)0xffffffffffffffffL)
+    return 0;
+  p = buf;
+  while((q = strchr(p, '\n')) != 0){
+    *q = 0;
+    if(match(pattern, p)){
+      *q = '\n';
+      write(1, p, q+1 - p);
+    }
+    p = q+1;
+  }
+  munmap(buf, st.size + 1);
+  return 1;
+}
+
 void
 grep(char *pattern, int fd)
 {
   int n, m;
   char *p, *q;
 
+  if(grepmap(pattern, fd))
+    return;
   m = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
     m += n;
@@ -0,0 +1,55 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/pstat.h"
+#include "user/user.h"
+
+// memstat [interval]
+// print the physical page allocator counters and the
+// free buddy blocks of each order; with an interval
+// (in ticks), keep polling and print the allocation
+// and free rates per tick over each interval.
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat ms, prev;
+  int interval = 0;
+
+  if(argc == 2)
+    interval = atoi(argv[1]);
+
+  if(memstat(&ms) < 0){
+    fprintf(2, "memstat: failed\n");
+    exit(1);
+  }
+  printf("total %l free %l cached %l zeroed %l hiwater %l\n",
+         ms.total, ms.free, ms.cached, ms.zeroed, ms.hiwater);
+  printf("nalloc %l nfree %l nfail %l\n", ms.nalloc, ms.nfree, ms.nfail);
+
+  // pages in free blocks too small for a 2^k-page request
+  // show how fragmented the buddy pool is.
+  uint64 below = 0, pool = 0;
+  for(int k = 0; k < NORDER; k++)
+    pool += ms.nblock[k] << k;
+  for(int k = 0; k < NORDER; k++){
+    printf("order %d: %l free blocks, %l%% of pool unusable\n", k,
+           ms.nblock[k], pool ? below * 100 / pool : 0);
+    below += ms.nblock[k] << k;
+  }
+
+  while(interval > 0){
+    prev = ms;
+    sleep(interval);
+    if(memstat(&ms) < 0){
+      fprintf(2, "memstat: failed\n");
+      exit(1);
+    }
+    uint dt = ms.ticks - prev.ticks;
+    if(dt == 0)
+      dt = 1;
+    printf("free %l hiwater %l alloc/tick %l free/tick %l\n",
+           ms.free, ms.hiwater,
+           (ms.nalloc - prev.nalloc) / dt, (ms.nfree - prev.nfree) / dt);
+  }
+  exit(0);
+}
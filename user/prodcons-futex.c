@@ -0,0 +1,113 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// prodcons-futex nproducers nconsumers [items]
+// prodcons-sem3 with the semaphores of usync.c, which enter
+// the kernel only to sleep and to wake sleepers: producers
+// and consumers pass items (default 10000) through a shared
+// ring, and the program prints the total consumed, which
+// should be items*(items+1)/2, and the time it took.
+
+#define BSIZE 10
+
+typedef struct {
+    int buf[BSIZE];
+    int nextin;
+    int nextout;
+    int num_produced;
+    int num_consumed;
+    int total;
+    int max;
+    usem_t occupied;
+    usem_t free;
+    umutex_t lock;
+} buffer_t;
+
+buffer_t *buffer;
+
+void producer()
+{
+  while(1) {
+    usem_wait(&buffer->free);
+    umutex_lock(&buffer->lock);
+    if (buffer->num_produced >= buffer->max) {
+        usem_post(&buffer->free);
+        usem_post(&buffer->occupied);
+        umutex_unlock(&buffer->lock);
+        exit(0);
+    }
+    buffer->num_produced++;
+    buffer->buf[buffer->nextin++] = buffer->num_produced;
+    buffer->nextin %= BSIZE;
+    usem_post(&buffer->occupied);
+    umutex_unlock(&buffer->lock);
+  }
+}
+
+void consumer()
+{
+  while(1) {
+    usem_wait(&buffer->occupied);
+    umutex_lock(&buffer->lock);
+    if (buffer->num_consumed >= buffer->max) {
+        usem_post(&buffer->occupied);
+        usem_post(&buffer->free);
+        umutex_unlock(&buffer->lock);
+        exit(0);
+    }
+    buffer->total += buffer->buf[buffer->nextout++];
+    buffer->nextout %= BSIZE;
+    buffer->num_consumed++;
+    usem_post(&buffer->free);
+    umutex_unlock(&buffer->lock);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 3 && argc != 4) {
+     printf("usage: %s <nproducers> <nconsumers> [items]\n", argv[0]);
+     exit(0);
+  }
+  int nproducers = atoi(argv[1]);
+  int nconsumers = atoi(argv[2]);
+  int i;
+  uint64 t0;
+
+  buffer = (buffer_t *) mmap(NULL, sizeof(buffer_t),
+                          PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  buffer->nextin = 0;
+  buffer->nextout = 0;
+  buffer->num_produced = 0;
+  buffer->num_consumed = 0;
+  buffer->total = 0;
+  buffer->max = argc == 4 ? atoi(argv[3]) : 10000;
+  usem_init(&buffer->occupied, 0);
+  usem_init(&buffer->free, BSIZE);
+  umutex_init(&buffer->lock);
+
+  for (i = 0; i < BSIZE; i++)
+    buffer->buf[i] = 0;
+
+  t0 = nanotime();
+  for (i = 0; i < nconsumers; i++)
+    if (!fork()) {
+      consumer();
+      exit(0);
+    }
+  for (i = 0; i < nproducers; i++)
+    if (!fork()) {
+      producer();
+      exit(0);
+    }
+  for (i = 0; i < nconsumers; i++)
+    wait(0);
+  for (i = 0; i < nproducers; i++)
+    wait(0);
+  printf("total = %d in %l us\n", buffer->total, (nanotime() - t0) / 1000);
+  munmap(buffer, sizeof(buffer_t));
+
+  exit(0);
+}
@@ -0,0 +1,64 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/pstat.h"
+#include "user/user.h"
+
+// schedctl [policy rr|mlfq|stride | boost ticks | slice level ticks | allot level ticks]
+// print the scheduling policy and the MLFQ tunables, after
+// changing one if asked: the policy, the priority boost
+// period (0 turns boosting off), or the time slice or
+// allotment of level 0 (HIGH) to 2 (LOW).
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: schedctl [policy rr|mlfq|stride | boost ticks | slice level ticks | allot level ticks]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct schedparam sp;
+  int level;
+
+  if(getsched(&sp) < 0){
+    fprintf(2, "schedctl: getsched failed\n");
+    exit(1);
+  }
+
+  if(argc == 3 && strcmp(argv[1], "policy") == 0){
+    if(strcmp(argv[2], "rr") == 0)
+      setpolicy(RR);
+    else if(strcmp(argv[2], "mlfq") == 0)
+      setpolicy(MLFQ);
+    else if(strcmp(argv[2], "stride") == 0)
+      setpolicy(STRIDE);
+    else
+      usage();
+    argc = 1;
+  } else if(argc == 3 && strcmp(argv[1], "boost") == 0){
+    sp.boost = atoi(argv[2]);
+  } else if(argc == 4 && (strcmp(argv[1], "slice") == 0 || strcmp(argv[1], "allot") == 0)){
+    level = atoi(argv[2]);
+    if(level < 0 || level >= NQUEUE)
+      usage();
+    if(argv[1][0] == 's')
+      sp.slice[level] = atoi(argv[3]);
+    else
+      sp.allot[level] = atoi(argv[3]);
+  } else if(argc != 1){
+    usage();
+  }
+  if(argc != 1 && setsched(&sp) < 0){
+    fprintf(2, "schedctl: bad value\n");
+    exit(1);
+  }
+
+  level = setpolicy(-1);
+  printf("policy %s\n", level == MLFQ ? "mlfq" : level == STRIDE ? "stride" : "rr");
+  printf("boost every %d ticks\n", sp.boost);
+  for(level = 0; level < NQUEUE; level++)
+    printf("level %d: slice %d allot %d\n", level, sp.slice[level], sp.allot[level]);
+  exit(0);
+}
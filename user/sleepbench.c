@@ -0,0 +1,57 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/pstat.h"
+#include "user/user.h"
+
+// sleepbench [rounds]
+// time nanosleep() for a range of durations, shorter and
+// longer than a clock tick, and print how late each wakes
+// on average; then sleep for a second and count the timer
+// interrupts every CPU took meanwhile, which should be few
+// with the system otherwise idle.
+
+uint64 durations[] = { 50000, 200000, 1000000, 5000000, 30000000, 150000000 };
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = 10;
+  uint64 t0, late, worst, n;
+  struct cpustat before, after;
+
+  if(argc >= 2)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    fprintf(2, "usage: sleepbench [rounds]\n");
+    exit(1);
+  }
+
+  for(int i = 0; i < sizeof(durations)/sizeof(durations[0]); i++){
+    late = worst = 0;
+    for(int r = 0; r < rounds; r++){
+      t0 = nanotime();
+      if(nanosleep(durations[i]) < 0){
+        fprintf(2, "sleepbench: nanosleep failed\n");
+        exit(1);
+      }
+      n = nanotime() - t0 - durations[i];
+      late += n;
+      if(n > worst)
+        worst = n;
+    }
+    printf("sleep %l us: late %l us on average, %l us at worst\n",
+           durations[i] / 1000, late / rounds / 1000, worst / 1000);
+  }
+
+  if(cpustat(&before) < 0){
+    fprintf(2, "sleepbench: cpustat failed\n");
+    exit(1);
+  }
+  nanosleep(1000000000);
+  cpustat(&after);
+  n = 0;
+  for(int i = 0; i < NCPU; i++)
+    n += after.ntimer[i] - before.ntimer[i];
+  printf("timer interrupts over 1 s of idle: %l\n", n);
+  exit(0);
+}
@@ -0,0 +1,85 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// stridebench [nchild [ticks]]
+// run the STRIDE policy with nchild spinners (default 2) in
+// each of three ticket classes, 100, 200 and 300, for ticks
+// clock ticks (default 200), and check that the work each
+// class gets done comes out in the ratio 1:2:3.  Use enough
+// children to keep every CPU busy, or there is nothing to
+// share out.
+
+#define NCLASS 3
+
+int
+main(int argc, char *argv[])
+{
+  int nchild = 2, ticks = 200;
+  int fds[2], old, ok;
+  uint64 work[NCLASS], n;
+  int deadline, class;
+
+  if(argc > 1)
+    nchild = atoi(argv[1]);
+  if(argc > 2)
+    ticks = atoi(argv[2]);
+  if(nchild < 1 || ticks < 1){
+    fprintf(2, "usage: stridebench [nchild [ticks]]\n");
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    fprintf(2, "stridebench: pipe failed\n");
+    exit(1);
+  }
+
+  old = setpolicy(STRIDE);
+  deadline = uptime() + ticks;
+  for(int i = 0; i < NCLASS * nchild; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "stridebench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      class = i % NCLASS;
+      settickets(100 * (class + 1));
+      n = 0;
+      while(uptime() < deadline){
+        for(volatile int k = 0; k < 10000; k++)
+          ;
+        n++;
+      }
+      write(fds[1], &class, sizeof(class));
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+
+  memset(work, 0, sizeof(work));
+  for(int i = 0; i < NCLASS * nchild; i++){
+    if(read(fds[0], &class, sizeof(class)) != sizeof(class) ||
+       read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      fprintf(2, "stridebench: short read\n");
+      exit(1);
+    }
+    work[class] += n;
+  }
+  for(int i = 0; i < NCLASS * nchild; i++)
+    wait(0);
+  setpolicy(old);
+
+  // each class should do (class+1) times the work of the
+  // first; allow 20% either way.
+  ok = work[0] > 0;
+  for(class = 0; class < NCLASS; class++){
+    uint64 ratio = work[0] ? work[class] * 100 / work[0] : 0;
+    printf("tickets %d: work %l ratio %l.%l%l (want %d.00)\n",
+           100 * (class + 1), work[class], ratio / 100, ratio / 10 % 10, ratio % 10, class + 1);
+    if(ratio * 10 < (class + 1) * 800 || ratio * 10 > (class + 1) * 1200)
+      ok = 0;
+  }
+  printf("stridebench: %s\n", ok ? "ok" : "FAIL");
+  exit(ok ? 0 : 1);
+}
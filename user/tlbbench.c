@@ -0,0 +1,65 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// tlbbench [megabytes [passes]]
+// compare TLB pressure on a heap buffer, which sbrk() backs
+// with 4 KiB pages, and on an mmap() region, which the
+// kernel backs with 2 MiB megapages.  each sweep touches one
+// byte per 4 KiB page, so every access needs a different
+// translation.  the first sweep also shows page fault cost.
+
+static int
+sweep(volatile char *buf, int size, int passes)
+{
+  int t0 = uptime();
+
+  for(int p = 0; p < passes; p++)
+    for(int i = 0; i < size; i += PGSIZE)
+      buf[i]++;
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb = 16, passes = 500, size;
+  int heapfault, heaptime, mapfault, maptime;
+  char *heap, *map;
+
+  if(argc >= 2)
+    mb = atoi(argv[1]);
+  if(argc >= 3)
+    passes = atoi(argv[2]);
+  if(mb <= 0 || passes <= 0){
+    fprintf(2, "usage: tlbbench [megabytes [passes]]\n");
+    exit(1);
+  }
+  size = mb * 1024 * 1024;
+
+  heap = sbrk(size);
+  if(heap == (char*)0xffffffffffffffffL){
+    fprintf(2, "tlbbench: sbrk failed\n");
+    exit(1);
+  }
+  heapfault = sweep(heap, size, 1);
+  heaptime = sweep(heap, size, passes);
+  sbrk(-size);
+
+  map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if(map == (char*)0xffffffffffffffffL){
+    fprintf(2, "tlbbench: mmap failed\n");
+    exit(1);
+  }
+  mapfault = sweep(map, size, 1);
+  maptime = sweep(map, size, passes);
+  munmap(map, size);
+
+  printf("%d MB x %d passes\n", mb, passes);
+  printf("heap (4 KiB pages):  first touch %d ticks, sweeps %d ticks\n",
+         heapfault, heaptime);
+  printf("mmap (megapages):    first touch %d ticks, sweeps %d ticks\n",
+         mapfault, maptime);
+  exit(0);
+}
@@ -2,6 +2,10 @@
 
 struct stat;
 struct rtcdate;
+struct memstat;
+struct cpustat;
+struct bstat;
+struct schedparam;
 
 // system calls
 int fork(void);
@@ -25,13 +29,42 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
-uint64 freemem(void);
+uint64 freepmem(void);
+int memstat(struct memstat*);
+void* mmap(void*, uint64, int, int, int, int);
+int munmap(void*, uint64);
+int madvise(void*, uint64, int);
+int cpustat(struct cpustat*);
+int getsched(struct schedparam*);
+int setsched(struct schedparam*);
+int setpolicy(int);
+int setclass(int, int);
+int settickets(int);
+int nanosleep(uint64);
+uint64 nanotime(void);
+int futex(int*, int, int);
+int bstat(struct bstat*);
 
 int sem_init(sem_t *sem, int pshared, unsigned int value);
 int sem_destroy(sem_t *sem);
 int sem_wait(sem_t *sem);
 int sem_post(sem_t *sem);
 
+// usync.c
+typedef struct {
+  int count;    // units available
+  int nwait;    // processes in usem_wait() that found none
+} usem_t;
+typedef struct {
+  int state;    // 0 unlocked, 1 locked, 2 locked with waiters
+} umutex_t;
+void usem_init(usem_t*, int);
+void usem_wait(usem_t*);
+void usem_post(usem_t*);
+void umutex_init(umutex_t*);
+void umutex_lock(umutex_t*);
+void umutex_unlock(umutex_t*);
+
 // ulib.c
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/pstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -2046,7 +2047,7 @@ iref(char *s)
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = NPROC + 1 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -2063,7 +2064,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2080,6 +2081,65 @@ forktest(char *s)
   }
 }
 
+// fork+exec from a parent with a large, dirty heap, the case
+// copy-on-write fork speeds up.  prints the time taken so
+// kernels can be compared, and checks that a child's stores
+// to shared pages don't show up in the parent.
+void
+forkexecbench(char *s)
+{
+  enum { N = 20, HEAP = 4*1024*1024 };
+  char *echoargv[] = { "echo", 0 };
+  int i, pid, xstatus, t0, t1;
+  char *a;
+
+  a = sbrk(HEAP);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < HEAP; i += PGSIZE)
+    a[i] = 'p';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < HEAP; i += PGSIZE)
+      a[i] = 'c';
+    exit(0);
+  }
+  wait(&xstatus);
+  for(i = 0; i < HEAP; i += PGSIZE){
+    if(a[i] != 'p'){
+      printf("%s: child's store visible in parent\n", s);
+      exit(1);
+    }
+  }
+
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      exec("echo", echoargv);
+      exit(1);
+    }
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: exec failed\n", s);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  printf("%d fork+exec with %d KB heap in %d ticks: ", N, HEAP/1024, t1 - t0);
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2350,6 +2410,1573 @@ sbrkarg(char *s)
   } 
 }
 
+// sbrk() shouldn't allocate memory until it is touched, and
+// system calls should be able to read and write heap pages
+// that no one has touched yet.
+void
+lazysbrk(char *s)
+{
+  enum { BIG = 32*1024*1024 };
+  uint64 before;
+  char *a;
+  int fd, i;
+
+  before = freepmem();
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  if(freepmem() + BIG/2 < before){
+    printf("%s: sbrk allocated memory up front\n", s);
+    exit(1);
+  }
+
+  fd = open("lazy", O_CREATE|O_RDWR);
+  unlink("lazy");
+  if(fd < 0){
+    printf("%s: open lazy failed\n", s);
+    exit(1);
+  }
+  // copyin() from an untouched page.
+  if(write(fd, a + BIG/2, 16) != 16){
+    printf("%s: write from untouched page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("README", O_RDONLY);
+  if(fd < 0){
+    printf("%s: open README failed\n", s);
+    exit(1);
+  }
+  // copyout() to an untouched page.
+  if(read(fd, a + BIG - 8, 8) != 8){
+    printf("%s: read into untouched page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < 16; i++){
+    if(a[BIG/2 + i] != 0){
+      printf("%s: untouched page not zero\n", s);
+      exit(1);
+    }
+  }
+
+  sbrk(-BIG);
+  if(freepmem() + BIG/2 < before){
+    printf("%s: shrinking heap leaked memory\n", s);
+    exit(1);
+  }
+}
+
+// a large mmap() region is backed by megapages; fork() must
+// still give the child a private copy, and munmap() of part
+// of a megapage must keep the rest mapped.
+void
+megamap(char *s)
+{
+  enum { SZ = 4*1024*1024 };
+  uint64 before;
+  char *a;
+  int i, pid, xstatus;
+
+  before = freepmem();
+  a = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i += PGSIZE)
+    a[i] = i / PGSIZE;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < SZ; i += PGSIZE){
+      if(a[i] != (char)(i / PGSIZE))
+        exit(1);
+      a[i] = 0;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw wrong data\n", s);
+    exit(1);
+  }
+
+  // drop the first 1 MB, splitting the first megapage.
+  if(munmap(a, SZ/4) < 0){
+    printf("%s: partial munmap failed\n", s);
+    exit(1);
+  }
+  for(i = SZ/4; i < SZ; i += PGSIZE){
+    if(a[i] != (char)(i / PGSIZE)){
+      printf("%s: parent saw child's store\n", s);
+      exit(1);
+    }
+  }
+  if(munmap(a + SZ/4, SZ - SZ/4) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  if(freepmem() + 64*PGSIZE < before){
+    printf("%s: munmap leaked memory\n", s);
+    exit(1);
+  }
+}
+
+// pages mapped ahead of time by fault-around must read as
+// zero, whatever the region's madvise() hint.
+void
+faultaround(char *s)
+{
+  enum { SZ = 64*PGSIZE };
+  int advice[] = { MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL };
+  char *a;
+  int i, j;
+
+  for(j = 0; j < sizeof(advice)/sizeof(advice[0]); j++){
+    a = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("%s: mmap failed\n", s);
+      exit(1);
+    }
+    if(madvise(a, SZ, advice[j]) < 0){
+      printf("%s: madvise failed\n", s);
+      exit(1);
+    }
+    for(i = SZ - PGSIZE; i >= 0; i -= PGSIZE){
+      if(a[i] != 0 || a[i + PGSIZE - 1] != 0){
+        printf("%s: page not zero\n", s);
+        exit(1);
+      }
+      a[i] = 1;
+    }
+    if(madvise(a, SZ, 99) != -1 || madvise(a, SZ + PGSIZE, MADV_NORMAL) != -1){
+      printf("%s: bad madvise succeeded\n", s);
+      exit(1);
+    }
+    munmap(a, SZ);
+  }
+}
+
+// file-backed mmap(): mappings see the file's data and later
+// write()s to it, stores to a shared mapping reach the file
+// on munmap() and are seen by a forked child at once, and
+// stores to a private mapping never reach the file.
+void
+mmapfile(char *s)
+{
+  enum { SZ = 3*PGSIZE + 100 };
+  char *a, *b;
+  int fd, fd2, i, pid, xstatus;
+  char c;
+
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    c = 'a' + i % 26;
+    if(write(fd, &c, 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+
+  a = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  b = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(a == (char*)0xffffffffffffffffL || b == (char*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++){
+    if(a[i] != 'a' + i % 26 || b[i] != 'a' + i % 26){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // write() reaches the mappings.
+  fd2 = open("mmapfile", O_RDWR);
+  if(fd2 < 0 || read(fd2, buf, PGSIZE) != PGSIZE || write(fd2, "X", 1) != 1){
+    printf("%s: rewrite failed\n", s);
+    exit(1);
+  }
+  close(fd2);
+  if(a[PGSIZE] != 'X' || b[PGSIZE] != 'X'){
+    printf("%s: mapping missed write()\n", s);
+    exit(1);
+  }
+
+  b[0] = 'P';
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a[2*PGSIZE] = 'C';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(a[2*PGSIZE] != 'C'){
+    printf("%s: parent missed child's store\n", s);
+    exit(1);
+  }
+  a[SZ-1] = 'Z';
+  if(munmap(a, SZ) < 0 || munmap(b, SZ) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  a = sbrk(SZ);
+  if(read(fd, a, SZ) != SZ){
+    printf("%s: file has wrong size\n", s);
+    exit(1);
+  }
+  if(a[0] != 'a' || a[2*PGSIZE] != 'C' || a[SZ-1] != 'Z'){
+    printf("%s: file has wrong data\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+}
+
+// thousands of mmap() regions, placed by address hint with
+// a gap between each pair so they can't merge; a fork()ed
+// child sees them all; munmap() punches holes in regions and
+// unmaps many regions at once.
+void
+mmaptree(char *s)
+{
+  enum { N = 2000, SZ = 16*PGSIZE };
+  char *base = (char*)0x1000000000L;
+  char *a, *b;
+  int i, pid, xstatus;
+
+  for(i = 0; i < N; i++){
+    a = mmap(base + 2*i*PGSIZE, PGSIZE, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+    if(a != base + 2*i*PGSIZE){
+      printf("%s: mmap %d at %p got %p\n", s, i, base + 2*i*PGSIZE, a);
+      exit(1);
+    }
+    *(int*)a = i;
+  }
+
+  // a hint that overlaps a region is ignored.
+  a = mmap(base, PGSIZE, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+  if(a == (char*)0xffffffffffffffffL || a == base){
+    printf("%s: mmap over a region\n", s);
+    exit(1);
+  }
+  munmap(a, PGSIZE);
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(*(int*)(base + 2*i*PGSIZE) != i){
+        printf("%s: child sees wrong data in region %d\n", s, i);
+        exit(1);
+      }
+      *(int*)(base + 2*i*PGSIZE) = -1;
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  for(i = 0; i < N; i++){
+    if(*(int*)(base + 2*i*PGSIZE) != i){
+      printf("%s: wrong data in region %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // one munmap() for all of them, gaps and all.
+  if(munmap(base, 2*N*PGSIZE) < 0){
+    printf("%s: munmap of all regions failed\n", s);
+    exit(1);
+  }
+  if(munmap(base, PGSIZE) != -1){
+    printf("%s: munmap of nothing succeeded\n", s);
+    exit(1);
+  }
+
+  // punch a hole in a region, then map the hole again.
+  a = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i += PGSIZE)
+    a[i] = i / PGSIZE;
+  if(munmap(a + 4*PGSIZE, 4*PGSIZE) < 0){
+    printf("%s: munmap of a hole failed\n", s);
+    exit(1);
+  }
+  b = mmap(a + 4*PGSIZE, 4*PGSIZE, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, 0);
+  if(b != a + 4*PGSIZE){
+    printf("%s: hole not reused\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i += PGSIZE){
+    if(a[i] != (i >= 4*PGSIZE && i < 8*PGSIZE ? 0 : i / PGSIZE)){
+      printf("%s: wrong data at page %d\n", s, i / PGSIZE);
+      exit(1);
+    }
+  }
+  if(munmap(a, SZ) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+}
+
+// CPUs with nothing to run park in wfi, and processes woken
+// for a parked CPU still run promptly: a pipe ping-pong, in
+// which every wakeup may need an IPI, takes well under a
+// tick per round trip.
+void
+cpuidle(char *s)
+{
+  enum { N = 100 };
+  struct cpustat a, b;
+  uint64 parked = 0;
+  int i, pid, t0, xstatus, ping[2], pong[2];
+  char c;
+
+  if(cpustat(&a) < 0){
+    printf("%s: cpustat failed\n", s);
+    exit(1);
+  }
+  sleep(2);
+  if(cpustat(&b) < 0){
+    printf("%s: cpustat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCPU; i++)
+    parked += b.nidle[i] - a.nidle[i];
+  if(parked == 0){
+    printf("%s: no CPU parked while all were idle\n", s);
+    exit(1);
+  }
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    c = i;
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1 || c != (char)i){
+      printf("%s: ping-pong failed\n", s);
+      exit(1);
+    }
+  }
+  if(uptime() - t0 > N/2){
+    printf("%s: %d round trips took %d ticks\n", s, N, uptime() - t0);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  close(ping[0]); close(ping[1]);
+  close(pong[0]); close(pong[1]);
+}
+
+// the MLFQ tunables read back as set, and bad ones are
+// refused.
+void
+schedparams(char *s)
+{
+  struct schedparam old, sp, got;
+
+  if(getsched(&old) < 0){
+    printf("%s: getsched failed\n", s);
+    exit(1);
+  }
+  sp = old;
+  sp.slice[0] = 0;
+  if(setsched(&sp) != -1){
+    printf("%s: zero slice accepted\n", s);
+    exit(1);
+  }
+  sp = old;
+  sp.boost = -1;
+  if(setsched(&sp) != -1){
+    printf("%s: negative boost accepted\n", s);
+    exit(1);
+  }
+  sp = old;
+  sp.boost = old.boost + 7;
+  sp.allot[1] = old.allot[1] + 3;
+  if(setsched(&sp) < 0 || getsched(&got) < 0){
+    printf("%s: setsched failed\n", s);
+    exit(1);
+  }
+  if(got.boost != sp.boost || got.allot[1] != sp.allot[1] || got.slice[2] != old.slice[2]){
+    printf("%s: tunables did not stick\n", s);
+    exit(1);
+  }
+  if(setsched(&old) < 0){
+    printf("%s: restore failed\n", s);
+    exit(1);
+  }
+}
+
+// scheduling classes are set per process and inherited by
+// fork(); a real-time child runs even while batch siblings
+// spin; and switching policy back and forth keeps every
+// process running.
+void
+schedclass(char *s)
+{
+  enum { NSPIN = 3 };
+  int i, pid, old, spinners[NSPIN], xstatus, t0;
+
+  if(setclass(0, 7) != -1 || setclass(1000000, SCHED_BATCH) != -1){
+    printf("%s: bad setclass succeeded\n", s);
+    exit(1);
+  }
+  if(setclass(0, SCHED_BATCH) != SCHED_NORMAL){
+    printf("%s: default class is not normal\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(setclass(0, SCHED_NORMAL) == SCHED_BATCH ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit class\n", s);
+    exit(1);
+  }
+
+  // batch spinners on every CPU, then a real-time child that
+  // must still get to run promptly.
+  for(i = 0; i < NSPIN; i++){
+    spinners[i] = fork();
+    if(spinners[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(spinners[i] == 0)
+      for(;;)
+        ;
+  }
+  setclass(0, SCHED_NORMAL);
+  old = setpolicy(MLFQ);
+  t0 = uptime();
+  pid = fork();
+  if(pid == 0){
+    setclass(0, SCHED_RT);
+    for(i = 0; i < 5; i++)
+      sleep(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  setpolicy(RR);
+  setpolicy(old);
+  for(i = 0; i < NSPIN; i++){
+    kill(spinners[i]);
+    wait(0);
+  }
+  if(xstatus != 0 || uptime() - t0 > 50){
+    printf("%s: real-time child starved\n", s);
+    exit(1);
+  }
+}
+
+// tickets are checked and inherited by fork(), and under
+// STRIDE spinners holding different tickets all run and exit.
+void
+stridetickets(char *s)
+{
+  enum { NSPIN = 4 };
+  int i, pid, old, spinners[NSPIN], xstatus;
+
+  if(settickets(0) != -1 || settickets(MAXTICKETS + 1) != -1){
+    printf("%s: bad settickets succeeded\n", s);
+    exit(1);
+  }
+  if(settickets(300) != STRIDETICKETS){
+    printf("%s: wrong default tickets\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(settickets(STRIDETICKETS) == 300 ? 0 : 1);
+  wait(&xstatus);
+  settickets(STRIDETICKETS);
+  if(xstatus != 0){
+    printf("%s: child did not inherit tickets\n", s);
+    exit(1);
+  }
+
+  old = setpolicy(STRIDE);
+  for(i = 0; i < NSPIN; i++){
+    spinners[i] = fork();
+    if(spinners[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(spinners[i] == 0){
+      settickets(1 + i * 100);
+      for(int j = 0; j < 20; j++){
+        for(volatile int k = 0; k < 1000000; k++)
+          ;
+        if(j % 5 == 0)
+          sleep(1);
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < NSPIN; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: spinner failed\n", s);
+      exit(1);
+    }
+  }
+  if(setpolicy(old) != STRIDE){
+    printf("%s: policy not stride\n", s);
+    exit(1);
+  }
+}
+
+// nanosleep() wakes after its deadline but well within a
+// clock tick, sleep() still counts ticks, and a sleeper that
+// is killed wakes at once.
+void
+nanosleeptest(char *s)
+{
+  uint64 t0, dt;
+  int pid, xstatus, t1;
+
+  for(int i = 0; i < 5; i++){
+    t0 = nanotime();
+    if(nanosleep(2000000) != 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+    dt = nanotime() - t0;
+    if(dt < 2000000 || dt >= (uint64)TICKCYCLES * NSPERCYCLE){
+      printf("%s: nanosleep(2ms) took %l ns\n", s, dt);
+      exit(1);
+    }
+  }
+
+  t1 = uptime();
+  sleep(2);
+  if(uptime() - t1 < 2){
+    printf("%s: sleep(2) woke early\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    nanosleep(100000000000ULL);
+    exit(0);
+  }
+  nanosleep(10000000);
+  t1 = uptime();
+  kill(pid);
+  wait(&xstatus);
+  if(uptime() - t1 > 10){
+    printf("%s: killed sleeper did not wake\n", s);
+    exit(1);
+  }
+}
+
+// sleepers on many channels, some sharing one: each wakeup
+// wakes the right ones, and a sleeper killed off a channel
+// doesn't get in the way of later sleeps on it.
+void
+wakechannels(char *s)
+{
+  enum { N = 8 };
+  int own[N][2], shared[2], pid, victim, xstatus;
+  char c = 'x';
+
+  if(pipe(shared) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    if(pipe(own[i]) < 0){
+      printf("%s: pipe failed\n", s);
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if(read(own[i][0], &c, 1) != 1 || c != 'a' + i)
+        exit(1);
+      exit(read(shared[0], &c, 1) == 1 ? 0 : 1);
+    }
+  }
+
+  // a victim killed while asleep on the shared pipe.
+  victim = fork();
+  if(victim == 0){
+    read(shared[0], &c, 1);
+    exit(0);
+  }
+  sleep(1);
+  kill(victim);
+  wait(0);
+
+  for(int i = N-1; i >= 0; i--){
+    c = 'a' + i;
+    if(write(own[i][1], &c, 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    if(write(shared[1], &c, 1) != 1){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: sleeper woke wrongly\n", s);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    close(own[i][0]);
+    close(own[i][1]);
+  }
+  close(shared[0]);
+  close(shared[1]);
+}
+
+// far more processes than the old fixed table held can live
+// at once, be found by pid to be killed, and be reaped; and
+// the children of an exiting process pass to init.
+void
+manyprocs(char *s)
+{
+  enum { N = 200 };
+  int pids[N], fds[2], n, pid, xstatus;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(n = 0; n < N; n++){
+    pids[n] = fork();
+    if(pids[n] < 0)
+      break;
+    if(pids[n] == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(n < N){
+    printf("%s: only %d forks worked\n", s, n);
+    for(int i = 0; i < n; i++)
+      kill(pids[i]);
+    for(int i = 0; i < n; i++)
+      wait(0);
+    exit(1);
+  }
+  for(int i = N-1; i >= 0; i--){
+    if(kill(pids[i]) != 0){
+      printf("%s: kill %d failed\n", s, pids[i]);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    if(wait(0) < 0){
+      printf("%s: wait stopped early\n", s);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1 || kill(pids[0]) != -1){
+    printf("%s: reaped child still there\n", s);
+    exit(1);
+  }
+
+  // a middle process leaves its children to init.
+  pid = fork();
+  if(pid == 0){
+    for(int i = 0; i < 10; i++)
+      if(fork() == 0){
+        sleep(2);
+        exit(0);
+      }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || wait(0) != -1){
+    printf("%s: reparenting failed\n", s);
+    exit(1);
+  }
+}
+
+// futex() checks the word before sleeping and wakes sleepers
+// on shared memory, and the usync.c mutex and semaphore built
+// on it keep processes in step.
+void
+futextest(char *s)
+{
+  enum { NCHILD = 4, ITERS = 1000 };
+  struct shared {
+    int word;
+    int counter;
+    umutex_t lock;
+    usem_t done;
+  } *sh;
+  int pid, xstatus, n;
+
+  sh = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if(sh == (struct shared*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  sh->word = 5;
+  if(futex(&sh->word, FUTEX_WAIT, 4) != -1 || futex(&sh->word, FUTEX_WAKE, 1) != 0 ||
+     futex((int*)((char*)&sh->word + 1), FUTEX_WAKE, 1) != -1){
+    printf("%s: futex checks failed\n", s);
+    exit(1);
+  }
+
+  // a child sleeps on the word until the parent changes it.
+  sh->word = 0;
+  pid = fork();
+  if(pid == 0){
+    while(sh->word == 0)
+      futex(&sh->word, FUTEX_WAIT, 0);
+    exit(0);
+  }
+  sleep(5);
+  __atomic_store_n(&sh->word, 1, __ATOMIC_SEQ_CST);
+  n = futex(&sh->word, FUTEX_WAKE, 1);
+  wait(&xstatus);
+  if(xstatus != 0 || n < 0 || n > 1){
+    printf("%s: futex wake failed\n", s);
+    exit(1);
+  }
+
+  // children count under the mutex and post when done.
+  sh->counter = 0;
+  umutex_init(&sh->lock);
+  usem_init(&sh->done, 0);
+  for(int i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(int j = 0; j < ITERS; j++){
+        umutex_lock(&sh->lock);
+        sh->counter++;
+        umutex_unlock(&sh->lock);
+      }
+      usem_post(&sh->done);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < NCHILD; i++)
+    usem_wait(&sh->done);
+  for(int i = 0; i < NCHILD; i++)
+    wait(0);
+  if(sh->counter != NCHILD * ITERS){
+    printf("%s: counter %d, expected %d\n", s, sh->counter, NCHILD * ITERS);
+    exit(1);
+  }
+  munmap(sh, PGSIZE);
+}
+
+// processes reading and writing their own files at once,
+// more blocks among them than the buffer cache holds, each
+// get back what they wrote, as buffers move between buckets.
+void
+bcachehash(char *s)
+{
+  enum { NCHILD = 4, NBLOCK = 16 };
+  char path[] = "bch0";
+  int pid, xstatus;
+
+  for(int i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      int fd;
+      path[3] = '0' + i;
+      fd = open(path, O_CREATE | O_RDWR);
+      if(fd < 0){
+        printf("%s: create %s failed\n", s, path);
+        exit(1);
+      }
+      for(int b = 0; b < NBLOCK; b++){
+        memset(buf, 'a' + i + b, BSIZE);
+        if(write(fd, buf, BSIZE) != BSIZE){
+          printf("%s: write %s failed\n", s, path);
+          exit(1);
+        }
+      }
+      close(fd);
+      for(int round = 0; round < 3; round++){
+        fd = open(path, O_RDONLY);
+        for(int b = 0; b < NBLOCK; b++){
+          if(read(fd, buf, BSIZE) != BSIZE){
+            printf("%s: read %s failed\n", s, path);
+            exit(1);
+          }
+          for(int j = 0; j < BSIZE; j++){
+            if(buf[j] != (char)('a' + i + b)){
+              printf("%s: %s block %d wrong\n", s, path, b);
+              exit(1);
+            }
+          }
+        }
+        close(fd);
+      }
+      unlink(path);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+}
+
+// the buffer cache grows past NBUF to hold a file bigger
+// than that while memory is plentiful, and gives pages back
+// when memory runs short.
+void
+bcachegrow(char *s)
+{
+  enum { NBLOCK = 2*NBUF };
+  struct bstat b0, b1;
+  int fd, pid, xstatus;
+
+  if(freepmem() < 4*BCACHEHIGH*PGSIZE){
+    printf("%s: not enough free memory, skipping\n", s);
+    return;
+  }
+  bstat(&b0);
+  fd = open("bcgrow", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create bcgrow failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'g', BSIZE);
+  for(int i = 0; i < NBLOCK; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write bcgrow failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  for(int round = 0; round < 2; round++){
+    fd = open("bcgrow", O_RDONLY);
+    for(int i = 0; i < NBLOCK; i++)
+      read(fd, buf, BSIZE);
+    close(fd);
+  }
+  if(bstat(&b1) < 0 || b1.nmiss <= b0.nmiss || b1.nhit <= b0.nhit || b1.nbuf < NBLOCK){
+    printf("%s: cache has %d buffers, expected at least %d\n", s, (int)b1.nbuf, NBLOCK);
+    exit(1);
+  }
+
+  // a child eats memory, then writes new blocks; each miss
+  // should give a page of the cache back.
+  pid = fork();
+  if(pid == 0){
+    while(freepmem() > BCACHELOW*PGSIZE/2){
+      char *a = sbrk(16*PGSIZE);
+      if(a == (char*)0xffffffffffffffffL)
+        break;
+      for(int i = 0; i < 16; i++)
+        a[i*PGSIZE] = 1;
+    }
+    fd = open("bcgrow2", O_CREATE | O_RDWR);
+    for(int i = 0; i < 8; i++)
+      write(fd, buf, BSIZE);
+    close(fd);
+    bstat(&b0);
+    exit(b0.nshrink > b1.nshrink ? 0 : 1);
+  }
+  wait(&xstatus);
+  unlink("bcgrow");
+  unlink("bcgrow2");
+  if(xstatus != 0){
+    printf("%s: cache did not shrink under memory pressure\n", s);
+    exit(1);
+  }
+}
+
+// sequential reads in odd-sized pieces, and two readers
+// taking turns on one file, which defeats read-ahead, both
+// see what was written.
+void
+readahead(char *s)
+{
+  enum { NBLOCK = 40, CHUNK = 700 };
+  int fd, fd1, fd2, n;
+  uint off;
+
+  fd = open("ra", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create ra failed\n", s);
+    exit(1);
+  }
+  for(int b = 0; b < NBLOCK; b++){
+    for(int j = 0; j < BSIZE; j++)
+      buf[j] = b + j / 64;
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write ra failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("ra", O_RDONLY);
+  for(off = 0; (n = read(fd, buf, CHUNK)) > 0; off += n){
+    for(int j = 0; j < n; j++){
+      if(buf[j] != (char)((off + j) / BSIZE + (off + j) % BSIZE / 64)){
+        printf("%s: byte %d wrong\n", s, off + j);
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+  if(off != NBLOCK * BSIZE){
+    printf("%s: read %d bytes, expected %d\n", s, off, NBLOCK * BSIZE);
+    exit(1);
+  }
+
+  fd1 = open("ra", O_RDONLY);
+  fd2 = open("ra", O_RDONLY);
+  off = 3*BSIZE + 100;
+  if(read(fd2, buf, off) != off){
+    printf("%s: read ra failed\n", s);
+    exit(1);
+  }
+  for(int b = 0; b < NBLOCK / 2; b++, off += BSIZE){
+    if(read(fd1, buf, BSIZE) != BSIZE || buf[100] != (char)(b + 1)){
+      printf("%s: fd1 block %d wrong\n", s, b);
+      exit(1);
+    }
+    if(read(fd2, buf, BSIZE) != BSIZE || buf[0] != (char)(off / BSIZE + 1)){
+      printf("%s: fd2 block %d wrong\n", s, off / BSIZE);
+      exit(1);
+    }
+  }
+  close(fd1);
+  close(fd2);
+  unlink("ra");
+}
+
+// commits write the log and install it with many disk writes
+// in flight at once; several processes writing big files at
+// the same time read back what they wrote.
+void
+asyncwrites(char *s)
+{
+  enum { NCHILD = 3, NBLOCK = 32 };
+  char path[] = "aw0";
+  int pid, xstatus;
+
+  for(int i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      int fd;
+      path[2] = '0' + i;
+      if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+        printf("%s: create %s failed\n", s, path);
+        exit(1);
+      }
+      for(int b = 0; b < NBLOCK; b += 4){
+        for(int j = 0; j < 4*BSIZE; j++)
+          buf[j] = i + b + j / BSIZE;
+        if(write(fd, buf, 4*BSIZE) != 4*BSIZE){
+          printf("%s: write %s failed\n", s, path);
+          exit(1);
+        }
+      }
+      close(fd);
+      fd = open(path, O_RDONLY);
+      for(int b = 0; b < NBLOCK; b++){
+        if(read(fd, buf, BSIZE) != BSIZE || buf[0] != (char)(i + b) || buf[BSIZE-1] != (char)(i + b)){
+          printf("%s: %s block %d wrong\n", s, path, b);
+          exit(1);
+        }
+      }
+      close(fd);
+      unlink(path);
+      exit(0);
+    }
+  }
+  for(int i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+}
+
+// a commit writes its consecutive log blocks to the disk in
+// fewer requests than blocks.
+void
+diskcoalesce(char *s)
+{
+  struct bstat b0, b1;
+  int fd;
+
+  fd = open("dc", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create dc failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'c', 3*BSIZE);
+  bstat(&b0);
+  if(write(fd, buf, 3*BSIZE) != 3*BSIZE){
+    printf("%s: write dc failed\n", s);
+    exit(1);
+  }
+  bstat(&b1);
+  close(fd);
+  unlink("dc");
+  if(b1.ndiskblock - b0.ndiskblock <= b1.ndiskreq - b0.ndiskreq){
+    printf("%s: %d blocks took %d requests\n", s,
+           (int)(b1.ndiskblock - b0.ndiskblock), (int)(b1.ndiskreq - b0.ndiskreq));
+    exit(1);
+  }
+}
+
+// two processes each read() one file into a fresh mapping of
+// the other's, so that each copy faults in a page of the
+// file the other is reading.
+void
+mmapcross(char *s)
+{
+  enum { SZ = 4*PGSIZE, ROUNDS = 20 };
+  char *names[2] = { "mmcrossa", "mmcrossb" };
+  int fd[2], pid, xstatus, me;
+  char *m;
+
+  for(int i = 0; i < 2; i++){
+    fd[i] = open(names[i], O_CREATE | O_RDWR);
+    memset(buf, 'a' + i, PGSIZE);
+    for(int j = 0; j < SZ / PGSIZE; j++){
+      if(fd[i] < 0 || write(fd[i], buf, PGSIZE) != PGSIZE){
+        printf("%s: create %s failed\n", s, names[i]);
+        exit(1);
+      }
+    }
+    close(fd[i]);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  me = pid == 0;
+  fd[0] = open(names[me], O_RDONLY);
+  fd[1] = open(names[!me], O_RDWR);
+  for(int r = 0; r < ROUNDS; r++){
+    m = mmap(0, SZ, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd[1], 0);
+    if(m == (char*)0xffffffffffffffffL){
+      printf("%s: mmap failed\n", s);
+      exit(1);
+    }
+    close(fd[0]);
+    fd[0] = open(names[me], O_RDONLY);
+    if(read(fd[0], m, SZ) != SZ || m[0] != 'a' + me || m[SZ-1] != 'a' + me){
+      printf("%s: read into mapping failed\n", s);
+      exit(1);
+    }
+    munmap(m, SZ);
+  }
+  close(fd[0]);
+  close(fd[1]);
+  if(pid == 0)
+    exit(0);
+  wait(&xstatus);
+  unlink(names[0]);
+  unlink(names[1]);
+  if(xstatus != 0)
+    exit(1);
+}
+
+// write() a mapping of a file back onto the end of the same
+// file, as "cat x >> x" would with a mapped buffer.
+void
+mmapappend(char *s)
+{
+  enum { SZ = 2*PGSIZE };
+  int fd;
+  char *m;
+
+  fd = open("mmappend", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'q', PGSIZE);
+  for(int i = 0; i < SZ / PGSIZE; i++){
+    if(write(fd, buf, PGSIZE) != PGSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  m = mmap(0, SZ, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(m == (char*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(write(fd, m, SZ) != SZ){
+    printf("%s: write from mapping failed\n", s);
+    exit(1);
+  }
+  munmap(m, SZ);
+  close(fd);
+
+  fd = open("mmappend", O_RDONLY);
+  for(int i = 0; i < 2*SZ / PGSIZE; i++){
+    if(read(fd, buf, PGSIZE) != PGSIZE || buf[0] != 'q' || buf[PGSIZE-1] != 'q'){
+      printf("%s: appended data wrong\n", s);
+      exit(1);
+    }
+  }
+  if(read(fd, buf, 1) != 0){
+    printf("%s: file too long\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmappend");
+}
+
+// read() from a pipe into, and write() to a pipe from, pages
+// of a file mapping that haven't been touched yet.  The pipe
+// copies under its spinlock, so the pages must be faulted in
+// before it.
+void
+mmappipe(char *s)
+{
+  enum { N = 100 };
+  int fd, pfd[2];
+  char *m;
+
+  fd = open("mmpipe", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'z', PGSIZE);
+  if(write(fd, buf, PGSIZE) != PGSIZE || write(fd, buf, PGSIZE) != PGSIZE){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  m = mmap(0, 2*PGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(m == (char*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(pipe(pfd) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  memset(buf, 'p', N);
+  if(write(pfd[1], buf, N) != N || read(pfd[0], m, N) != N){
+    printf("%s: read from pipe into mapping failed\n", s);
+    exit(1);
+  }
+  if(write(pfd[1], m + PGSIZE, N) != N){
+    printf("%s: write to pipe from mapping failed\n", s);
+    exit(1);
+  }
+  memset(buf, 0, N);
+  if(read(pfd[0], buf, N) != N || buf[0] != 'z' || buf[N-1] != 'z'){
+    printf("%s: wrong data through pipe\n", s);
+    exit(1);
+  }
+  close(pfd[0]);
+  close(pfd[1]);
+  munmap(m, 2*PGSIZE);
+
+  fd = open("mmpipe", O_RDONLY);
+  if(fd < 0 || read(fd, buf, PGSIZE) != PGSIZE){
+    printf("%s: reopen failed\n", s);
+    exit(1);
+  }
+  if(buf[0] != 'p' || buf[N-1] != 'p' || buf[N] != 'z'){
+    printf("%s: shared mapping not written back\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("mmpipe");
+}
+
+// wait() with a bad status address fails, but leaves the
+// child to be reaped by the next wait().
+void
+waitbadaddr(char *s)
+{
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(7);
+  if(wait((int*)0xffffffffffffff00L) != -1){
+    printf("%s: wait with a bad address succeeded\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7){
+    printf("%s: child lost by failed wait\n", s);
+    exit(1);
+  }
+}
+
+// Fork nproc children that each grow and shrink their heap
+// over and over, all at once, so that pages move between the
+// per-CPU caches of every hart and the global pool, and wait
+// for them.
+static void
+kallocrun(char *s, int nproc)
+{
+  enum { NPG = 256, ROUNDS = 20 };
+  int i, pid, xstatus;
+  char *a;
+
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(int r = 0; r < ROUNDS; r++){
+        a = sbrk(NPG*PGSIZE);
+        if(a == (char*)0xffffffffffffffffL)
+          exit(1);
+        for(int j = 0; j < NPG; j++)
+          a[j*PGSIZE] = r;
+        sbrk(-NPG*PGSIZE);
+      }
+      exit(0);
+    }
+  }
+  for(i = 0; i < nproc; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child failed to allocate\n", s);
+      exit(1);
+    }
+  }
+}
+
+// Pages allocated and freed by many processes on every hart
+// all come back: once they are done, the free count, which
+// includes the per-CPU caches, is what it was before.
+void
+kallocstress(char *s)
+{
+  struct memstat a, b;
+  int i;
+
+  // a first run leaves the caches that outlive a process, such
+  // as idle kernel stacks, at their steady size.
+  kallocrun(s, 2*NCPU);
+  if(memstat(&a) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+  kallocrun(s, 2*NCPU);
+  for(i = 0; i < 10; i++){
+    if(memstat(&b) < 0){
+      printf("%s: memstat failed\n", s);
+      exit(1);
+    }
+    if(b.free >= a.free)
+      break;
+    sleep(1);
+  }
+  if(b.free < a.free){
+    printf("%s: %d pages free before, %d after\n", s, (int)a.free, (int)b.free);
+    exit(1);
+  }
+}
+
+// Mixed-order allocations fragment the buddy pool, and freeing
+// them joins the blocks up again: 2 MiB megapages for mmap()
+// regions and single pages for the heap, allocated in turn and
+// freed in a different order, leave as many free 2 MiB blocks
+// as before, and megapages can then be had again.
+void
+buddycoalesce(char *s)
+{
+  enum { NREG = 8, NPG = 64 };
+  struct memstat a, b, c;
+  char *m[NREG], *heap, *mp;
+  int i, k;
+
+  if(memstat(&a) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+
+  heap = sbrk(0);
+  for(i = 0; i < NREG; i++){
+    m[i] = mmap(0, 2*MEGAPGSIZE, PROT_READ | PROT_WRITE,
+                MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(m[i] == (char*)0xffffffffffffffffL){
+      printf("%s: mmap failed\n", s);
+      exit(1);
+    }
+    mp = (char*)MEGAROUNDUP((uint64)m[i]);
+    mp[0] = 1;
+    if(sbrk(NPG*PGSIZE) == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk failed\n", s);
+      exit(1);
+    }
+    for(k = 0; k < NPG; k++)
+      heap[(i*NPG + k)*PGSIZE] = 1;
+  }
+  for(i = 0; i < NREG; i += 2)
+    munmap(m[i], 2*MEGAPGSIZE);
+  sbrk(-NREG*NPG*PGSIZE);
+  for(i = 1; i < NREG; i += 2)
+    munmap(m[i], 2*MEGAPGSIZE);
+
+  // a few free pages may stay in per-CPU caches, keeping a
+  // block or two apart.
+  if(memstat(&b) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+  if(b.nblock[NORDER-1] + 2 < a.nblock[NORDER-1]){
+    printf("%s: %d free 2 MiB blocks before, %d after\n", s,
+           (int)a.nblock[NORDER-1], (int)b.nblock[NORDER-1]);
+    exit(1);
+  }
+
+  // each touched megapage-aligned stretch takes a whole block.
+  k = b.nblock[NORDER-1] / 2;
+  if(k > NREG)
+    k = NREG;
+  mp = mmap(0, (k+1)*MEGAPGSIZE, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  if(mp == (char*)0xffffffffffffffffL){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < k; i++)
+    ((char*)MEGAROUNDUP((uint64)mp))[i*MEGAPGSIZE] = 1;
+  if(memstat(&c) < 0){
+    printf("%s: memstat failed\n", s);
+    exit(1);
+  }
+  if((int)(b.nblock[NORDER-1] - c.nblock[NORDER-1]) < k){
+    printf("%s: got %d of %d megapages\n", s,
+           (int)(b.nblock[NORDER-1] - c.nblock[NORDER-1]), k);
+    exit(1);
+  }
+  munmap(mp, (k+1)*MEGAPGSIZE);
+}
+
+// The file table has no fixed size any more: more processes
+// than the old NFILE (100) limit allowed hold open pipes and
+// files at once, and many opens and closes after that reuse
+// the freed structures.
+void
+filechurn(char *s)
+{
+  enum { NCHILD = 12, NPIPE = 5, ROUNDS = 500 };
+  int i, n, fd, xstatus, failed = 0, ready[2], done[2], fds[2];
+  char c;
+
+  fd = open("churn", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(pipe(ready) < 0 || pipe(done) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  // each child holds 2*NPIPE + 1 files of its own, 132 in all.
+  for(i = 0; i < NCHILD; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(done[1]);
+      for(n = 0; n < NPIPE; n++)
+        if(pipe(fds) < 0)
+          exit(1);
+      if(open("churn", O_RDONLY) < 0)
+        exit(1);
+      write(ready[1], "x", 1);
+      close(ready[1]);
+      read(done[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(done[0]);
+  for(n = 0; read(ready[0], &c, 1) == 1; n++)
+    ;
+  close(ready[0]);
+  close(done[1]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      failed = 1;
+  }
+  if(n != NCHILD || failed){
+    printf("%s: only %d of %d children opened all their files\n", s, n, NCHILD);
+    exit(1);
+  }
+
+  for(i = 0; i < ROUNDS; i++){
+    if(pipe(fds) < 0 || (fd = open("churn", O_RDONLY)) < 0){
+      printf("%s: open failed in round %d\n", s, i);
+      exit(1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    close(fd);
+  }
+  unlink("churn");
+}
+
+// Children are queued on their parent's CPU, so with NCPU+1 of
+// them spinning, other harts have them to run only by stealing:
+// more than one hart must be busy while they spin.  Skipped on
+// a single hart.
+void
+runqsteal(char *s)
+{
+  enum { N = NCPU + 1, SPIN = 10 };
+  struct cpustat a, b;
+  int i, online = 0, busy = 0, xstatus, t0;
+  uint64 dt;
+
+  if(cpustat(&a) < 0){
+    printf("%s: cpustat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCPU; i++)
+    online += a.online[i];
+  if(online < 2)
+    return;
+
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      while(uptime() < t0 + SPIN)
+        ;
+      exit(0);
+    }
+  }
+  if(cpustat(&a) < 0){
+    printf("%s: cpustat failed\n", s);
+    exit(1);
+  }
+  sleep(SPIN / 2);
+  if(cpustat(&b) < 0){
+    printf("%s: cpustat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+
+  // a hart ran children if it sat idle less than half the
+  // time and took clock ticks; one parked throughout took no
+  // ticks and has yet to add its idle time.
+  dt = b.time - a.time;
+  for(i = 0; i < NCPU; i++)
+    if(b.online[i] && (b.idle[i] - a.idle[i]) * 2 < dt &&
+       b.ntimer[i] - a.ntimer[i] >= SPIN/2 - 2)
+      busy++;
+  if(busy < 2){
+    printf("%s: only %d of %d harts ran the spinning children\n", s, busy, online);
+    exit(1);
+  }
+}
+
 void
 validatetest(char *s)
 {
@@ -2858,6 +4485,32 @@ main(int argc, char *argv[])
     {kernmem, "kernmem"},
     {sbrkfail, "sbrkfail"},
     {sbrkarg, "sbrkarg"},
+    {lazysbrk, "lazysbrk"},
+    {megamap, "megamap"},
+    {faultaround, "faultaround"},
+    {mmapfile, "mmapfile"},
+    {mmaptree, "mmaptree"},
+    {cpuidle, "cpuidle"},
+    {schedparams, "schedparams"},
+    {schedclass, "schedclass"},
+    {stridetickets, "stridetickets"},
+    {nanosleeptest, "nanosleeptest"},
+    {wakechannels, "wakechannels"},
+    {manyprocs, "manyprocs"},
+    {futextest, "futextest"},
+    {bcachehash, "bcachehash"},
+    {bcachegrow, "bcachegrow"},
+    {readahead, "readahead"},
+    {asyncwrites, "asyncwrites"},
+    {diskcoalesce, "diskcoalesce"},
+    {mmapcross, "mmapcross"},
+    {mmapappend, "mmapappend"},
+    {mmappipe, "mmappipe"},
+    {waitbadaddr, "waitbadaddr"},
+    {kallocstress, "kallocstress"},
+    {buddycoalesce, "buddycoalesce"},
+    {filechurn, "filechurn"},
+    {runqsteal, "runqsteal"},
     {sbrklast, "sbrklast"},
     {sbrk8000, "sbrk8000"},
     {validatetest, "validatetest"},
@@ -2880,6 +4533,7 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {forkexecbench, "forkexecbench"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
@@ -0,0 +1,84 @@
+// Semaphores and mutexes that live in user memory.
+//
+// Both are ints changed with atomic instructions, so taking
+// or giving one that nobody is waiting for is a few
+// instructions and no system call.  Only a process that has
+// to wait enters the kernel, to sleep with futex(), and only
+// then does giving one up call futex() to wake it.  Put them
+// in MAP_SHARED memory to use them between processes.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+void
+usem_init(usem_t *s, int count)
+{
+  s->count = count;
+  s->nwait = 0;
+}
+
+// Take a unit, sleeping until there is one.
+void
+usem_wait(usem_t *s)
+{
+  int c;
+
+  for(;;){
+    c = __atomic_load_n(&s->count, __ATOMIC_SEQ_CST);
+    if(c > 0){
+      if(__atomic_compare_exchange_n(&s->count, &c, c - 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return;
+      continue;
+    }
+    // announce ourselves before sleeping, so that usem_post()
+    // either sees us and wakes us, or has raised count
+    // already and futex() returns at once.
+    __atomic_fetch_add(&s->nwait, 1, __ATOMIC_SEQ_CST);
+    futex(&s->count, FUTEX_WAIT, 0);
+    __atomic_fetch_sub(&s->nwait, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+// Give a unit back, waking a sleeper if there are any.
+void
+usem_post(usem_t *s)
+{
+  __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&s->nwait, __ATOMIC_SEQ_CST) > 0)
+    futex(&s->count, FUTEX_WAKE, 1);
+}
+
+void
+umutex_init(umutex_t *m)
+{
+  m->state = 0;
+}
+
+void
+umutex_lock(umutex_t *m)
+{
+  int c = 0;
+
+  if(__atomic_compare_exchange_n(&m->state, &c, 1, 0,
+                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  // contended: mark the mutex as having waiters, and sleep
+  // until we are the one to change it from unlocked.
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void
+umutex_unlock(umutex_t *m)
+{
+  if(__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
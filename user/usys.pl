@@ -37,6 +37,20 @@ entry("sbrk");
 entry("sleep");
 entry("uptime");
 entry("freepmem");
+entry("memstat");
+entry("mmap");
+entry("munmap");
+entry("madvise");
+entry("cpustat");
+entry("getsched");
+entry("setsched");
+entry("setpolicy");
+entry("setclass");
+entry("settickets");
+entry("nanosleep");
+entry("nanotime");
+entry("futex");
+entry("bstat");
 entry("seminit");
 entry("semwait");
 entry("sempost");
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+// wakebench [maxpairs [rounds [sleepers]]]
+// pass a byte back and forth over a pair of pipes, rounds
+// times, in 1, 2, 4, ... maxpairs pairs of processes at once
+// (default 8), and print the round trips per second all the
+// pairs made together.  every round trip is two sleeps and
+// two wakeups, so throughput that keeps up as pairs are
+// added means that wakeups on different channels don't get
+// in each other's way.  given sleepers, that many more
+// processes are left asleep the whole time, which a wakeup
+// that looks at every process would pay for.
+
+static void
+pingpong(int rounds)
+{
+  int a[2], b[2];
+  char c = 0;
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    fprintf(2, "wakebench: pipe failed\n");
+    exit(1);
+  }
+  if(fork() == 0){
+    for(int i = 0; i < rounds; i++){
+      if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+  for(int i = 0; i < rounds; i++){
+    if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1)
+      exit(1);
+  }
+  wait(0);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxpairs = 8, rounds = 2000, nsleepers = 0;
+  int hold[2], pid;
+  uint64 t0, dt;
+
+  if(argc >= 2)
+    maxpairs = atoi(argv[1]);
+  if(argc >= 3)
+    rounds = atoi(argv[2]);
+  if(argc >= 4)
+    nsleepers = atoi(argv[3]);
+  if(maxpairs < 1 || rounds < 1 || 2*maxpairs + nsleepers + 4 > NPROC){
+    fprintf(2, "usage: wakebench [maxpairs [rounds [sleepers]]]\n");
+    exit(1);
+  }
+
+  // sleepers block reading a pipe that no one writes.
+  if(pipe(hold) < 0){
+    fprintf(2, "wakebench: pipe failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < nsleepers; i++){
+    if(fork() == 0){
+      char c;
+      close(hold[1]);
+      read(hold[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(hold[0]);
+
+  for(int n = 1; n <= maxpairs; n *= 2){
+    t0 = nanotime();
+    for(int i = 0; i < n; i++){
+      pid = fork();
+      if(pid < 0){
+        fprintf(2, "wakebench: fork failed\n");
+        exit(1);
+      }
+      if(pid == 0)
+        pingpong(rounds);
+    }
+    for(int i = 0; i < n; i++)
+      wait(0);
+    dt = nanotime() - t0;
+    printf("%d pairs: %l round trips/s\n", n, (uint64)n * rounds * 1000000 / (dt / 1000 + 1));
+  }
+
+  close(hold[1]);
+  for(int i = 0; i < nsleepers; i++)
+    wait(0);
+  exit(0);
+}